@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <monome.h>
+
+#include "./frame_buffer.h"
+#include "./util.h"
+
+// App is a program hosted by monod. Apps never touch the board directly; they
+// draw into the shared frame buffer, and keep their state while inactive.
+class App {
+public:
+  virtual ~App() {}
+
+  // the name used to select the app
+  virtual const char *name() const = 0;
+
+  // the app became active; the frame buffer is cleared before this is called
+  virtual void activate(FrameBuffer &fb) = 0;
+
+  // handle a key event
+  virtual void on_key(const monome_event_t *e, FrameBuffer &fb) {
+    UNUSED(e);
+    UNUSED(fb);
+  }
+
+  // advance the app; returns the millis until the next step, or -1 to idle
+  // until the next key event
+  virtual int step(FrameBuffer &fb) = 0;
+};
+
+// ClearApp leaves the board dark.
+class ClearApp : public App {
+public:
+  const char *name() const override { return "clear"; }
+
+  void activate(FrameBuffer &fb) override { UNUSED(fb); }
+
+  int step(FrameBuffer &fb) override {
+    UNUSED(fb);
+    return -1;
+  }
+};
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// the rules of life for a single cell
+static inline bool life_rule(bool live, size_t neighbors) {
+  return neighbors == 3 || (live && neighbors == 2);
+}
+
+// BlockLUT steps a toroidal world in 2x2 blocks. The table maps each 4x4
+// neighbourhood (bit 4 * dy + dx) to the next generation of its 2x2 centre
+// (bit 2 * cy + cx). Worlds are stored column major, i.e. x * rows + y, and
+// must have an even number of rows and columns.
+class BlockLUT {
+public:
+  BlockLUT() : table_(1 << 16) {
+    for (size_t n = 0; n < table_.size(); n++) {
+      uint8_t out = 0;
+      for (int cy = 0; cy < 2; cy++) {
+        for (int cx = 0; cx < 2; cx++) {
+          size_t nn = 0;
+          for (int dy = 0; dy < 3; dy++) {
+            for (int dx = 0; dx < 3; dx++) {
+              if (dx != 1 || dy != 1) {
+                nn += bit(n, cx + dx, cy + dy);
+              }
+            }
+          }
+          if (life_rule(bit(n, cx + 1, cy + 1), nn)) {
+            out |= 1 << (2 * cy + cx);
+          }
+        }
+      }
+      table_[n] = out;
+    }
+  }
+
+  // compute the next generation of cur into next
+  void step(const std::vector<uint8_t> &cur, std::vector<uint8_t> &next,
+            int cols, int rows) {
+    // copy the world into a padded grid so the block loop never wraps: each
+    // column gets its wrapped top and bottom cells, and then the first and
+    // last padded columns are copies of the opposite edges
+    const int pr = rows + 2;
+    padded_.resize((cols + 2) * pr);
+    for (int x = 0; x < cols; x++) {
+      const uint8_t *src = &cur[x * rows];
+      uint8_t *dst = &padded_[(x + 1) * pr];
+      dst[0] = src[rows - 1];
+      std::memcpy(dst + 1, src, rows);
+      dst[rows + 1] = src[0];
+    }
+    std::memcpy(&padded_[0], &padded_[cols * pr], pr);
+    std::memcpy(&padded_[(cols + 1) * pr], &padded_[pr], pr);
+
+    for (int x = 0; x < cols; x += 2) {
+      const uint8_t *col = &padded_[x * pr];
+      for (int y = 0; y < rows; y += 2) {
+        unsigned int n = 0;
+        for (int dx = 0; dx < 4; dx++) {
+          const uint8_t *p = col + dx * pr + y;
+          n |= (p[0] | p[1] << 4 | p[2] << 8 | p[3] << 12) << dx;
+        }
+        const uint8_t out = table_[n];
+        next[x * rows + y] = out & 1;
+        next[(x + 1) * rows + y] = (out >> 1) & 1;
+        next[x * rows + y + 1] = (out >> 2) & 1;
+        next[(x + 1) * rows + y + 1] = (out >> 3) & 1;
+      }
+    }
+  }
+
+  // check the table against the per-cell rules on random worlds
+  bool verify(int cols, int rows, int worlds, int generations) {
+    std::default_random_engine gen(std::random_device{}());
+    std::bernoulli_distribution dist(0.5);
+    std::vector<uint8_t> cur(cols * rows), expected(cols * rows),
+        actual(cols * rows);
+    for (int w = 0; w < worlds; w++) {
+      for (auto &cell : cur) {
+        cell = dist(gen);
+      }
+      for (int g = 0; g < generations; g++) {
+        for (int x = 0; x < cols; x++) {
+          for (int y = 0; y < rows; y++) {
+            size_t nn = 0;
+            for (int dx = -1; dx <= 1; dx++) {
+              for (int dy = -1; dy <= 1; dy++) {
+                if (dx || dy) {
+                  nn += cur[((x + dx + cols) % cols) * rows +
+                            (y + dy + rows) % rows];
+                }
+              }
+            }
+            expected[x * rows + y] = life_rule(cur[x * rows + y], nn);
+          }
+        }
+        step(cur, actual, cols, rows);
+        if (actual != expected) {
+          return false;
+        }
+        cur.swap(actual);
+      }
+    }
+    return true;
+  }
+
+private:
+  std::vector<uint8_t> table_;
+  std::vector<uint8_t> padded_;
+
+  static bool bit(size_t n, int x, int y) { return (n >> (4 * y + x)) & 1; }
+};
@@ -21,13 +21,16 @@
 #include <cstring>
 #include <filesystem>
 #include <functional>
-#include <iostream>
+#include <memory>
 #include <sstream>
 #include <string>
 
 #include <event2/event.h>
 #include <monome.h>
 
+#include "./log.h"
+#include "./serial_transport.h"
+
 // the prefix for the board device
 static const std::string devicePrefix = "/dev/ttyUSB";
 
@@ -64,6 +67,13 @@ public:
   ~Board() {
     if (m_ != nullptr) {
       clear();
+      if (transport_) {
+        try {
+          transport_->flush();
+        } catch (const std::runtime_error &) {
+          // nothing useful to do about this while closing the board
+        }
+      }
       monome_close(m_);
     }
     if (base_ != nullptr) {
@@ -93,6 +103,19 @@ public:
     event_base_dispatch(base_);
   }
 
+  // buffer led commands until flush() instead of writing each one to the
+  // device as it's made; errors are reported by flush()
+  void enable_buffering() {
+    transport_ = std::make_unique<SerialTransport>(m_);
+  }
+
+  // write out buffered led commands, if buffering is enabled
+  void flush() const {
+    if (transport_) {
+      transport_->flush();
+    }
+  }
+
   // poll for events
   void poll_events() {
     while (monome_event_handle_next(m_))
@@ -101,17 +124,27 @@ public:
 
   // set all leds to a color
   void led_all(unsigned int val) const {
-    if (monome_led_all(m_, val) == -1) {
+    if (transport_) {
+      transport_->led_all(val);
+    } else if (monome_led_all(m_, val) == -1) {
       throw std::runtime_error("failed to led_all");
     }
   }
 
   // force clear the board; note that this does not do any error checking
-  void clear() const { monome_led_all(m_, 0); }
+  void clear() const {
+    if (transport_) {
+      transport_->led_all(0);
+    } else {
+      monome_led_all(m_, 0);
+    }
+  }
 
   // turn an led on
   void led_on(int x, int y) const {
-    if (monome_led_on(m_, x, y) == -1) {
+    if (transport_) {
+      transport_->led_on(x, y);
+    } else if (monome_led_on(m_, x, y) == -1) {
       std::ostringstream os;
       os << "failed to led_on at position " << x << ", " << y;
       throw std::runtime_error(os.str());
@@ -120,7 +153,9 @@ public:
 
   // turn an led off
   void led_off(int x, int y) const {
-    if (monome_led_off(m_, x, y) == -1) {
+    if (transport_) {
+      transport_->led_off(x, y);
+    } else if (monome_led_off(m_, x, y) == -1) {
       std::ostringstream os;
       os << "failed to led_off at position " << x << ", " << y;
       throw std::runtime_error(os.str());
@@ -135,7 +170,11 @@ public:
 
   // set the led intensity
   void led_intensity(unsigned int intensity) const {
-    monome_led_intensity(m_, intensity);
+    if (transport_) {
+      transport_->led_intensity(intensity);
+    } else {
+      monome_led_intensity(m_, intensity);
+    }
   }
 
   // set an event function
@@ -154,6 +193,7 @@ private:
   monome_t *m_;
   event_base *base_;
   event_fn event_fn_;
+  std::unique_ptr<SerialTransport> transport_;
 };
 
 // default event handler
@@ -161,11 +201,10 @@ static void default_event_handler(const monome_event_t *e) {
   const int x = e->grid.x;
   const int y = e->grid.y;
   if (e->event_type == MONOME_BUTTON_DOWN) {
-    std::cout << "KEY DOWN ";
+    LOG_DEBUG("KEY DOWN %d %d", x, y);
   } else if (e->event_type == MONOME_BUTTON_UP) {
-    std::cout << "KEY UP   ";
+    LOG_DEBUG("KEY UP   %d %d", x, y);
   }
-  std::cout << x << " " << y << "\n";
 }
 
 static void on_keypress(const monome_event_t *e, void *data) {
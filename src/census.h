@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./log.h"
+#include "./ring_buffer.h"
+
+// a settled soup waiting to be censused
+struct Soup {
+  int cols;
+  int rows;
+  uint64_t generations;
+
+  // one byte per cell, stored x * rows + y
+  std::vector<uint8_t> world;
+};
+
+// Census classifies the objects left in settled soups on a worker thread. Each
+// soup is split into clusters of live cells on the torus, each cluster is
+// canonicalised under rotation and reflection, and the objects are counted by
+// name across all soups. Oscillators are classified in whatever phase they
+// were in when the soup settled. A phase that falls apart is only rejoined
+// when it's in two pieces, which covers every oscillator in the table.
+// Objects that wrap around the whole torus are counted by size alone.
+class Census {
+public:
+  // the number of soups that can be queued for the worker
+  static const size_t kCapacity = 64;
+
+  // log the totals every this many soups
+  static const uint64_t kReportInterval = 100;
+
+  Census()
+      : queue_(kCapacity), dropped_(0), stop_(false), names_(KnownNames()),
+        soups_(0), thread_([this]() { work(); }) {}
+
+  // delete copy ctor
+  Census(const Census &other) = delete;
+
+  ~Census() { stop(); }
+
+  // queue a soup for the census; this never blocks, and the soup is dropped
+  // if the worker is too far behind
+  void submit(Soup &&soup) {
+    if (!queue_.try_push(std::move(soup))) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // finish the queued soups, stop the worker and log the totals; later calls
+  // do nothing
+  void stop() {
+    if (stop_.exchange(true, std::memory_order_acq_rel)) {
+      return;
+    }
+    thread_.join();
+    report();
+  }
+
+private:
+  using Cell = std::pair<int, int>;
+
+  RingBuffer<Soup> queue_;
+  std::atomic<size_t> dropped_;
+  std::atomic<bool> stop_;
+
+  // the rest is only touched by the worker (or after it's been joined)
+  std::unordered_map<std::string, std::string> names_;
+  std::unordered_map<std::string, uint64_t> totals_;
+  uint64_t soups_;
+  std::thread thread_;
+
+  // well known objects, in every phase that can show up in a settled soup
+  static inline const std::vector<
+      std::pair<const char *, std::vector<const char *>>>
+      kKnownObjects = {
+          {"block", {"##/##"}},
+          {"blinker", {"###"}},
+          {"beehive", {".##./#..#/.##."}},
+          {"loaf", {".##./#..#/.#.#/..#."}},
+          {"boat", {"##./#.#/.#."}},
+          {"ship", {"##./#.#/.##"}},
+          {"tub", {".#./#.#/.#."}},
+          {"pond", {".##./#..#/#..#/.##."}},
+          {"barge", {".#../#.#./.#.#/..#."}},
+          {"long boat", {"##../#.#./.#.#/..#."}},
+          {"toad", {".###/###.", "..#./#..#/#..#/.#.."}},
+          {"beacon", {"##../##../..##/..##", "##../#.../...#/..##"}},
+          {"glider", {".#./..#/###", "#.#/.##/.#."}},
+      };
+
+  // map the canonical keys of the well known objects to their names
+  static std::unordered_map<std::string, std::string> KnownNames() {
+    std::unordered_map<std::string, std::string> names;
+    for (const auto &pr : kKnownObjects) {
+      for (const char *pattern : pr.second) {
+        names[canonicalise(parse(pattern))] = pr.first;
+      }
+    }
+    return names;
+  }
+
+  // parse a pattern like ".#./..#/###" into cells
+  static std::vector<Cell> parse(const char *pattern) {
+    std::vector<Cell> cells;
+    int x = 0, y = 0;
+    for (const char *p = pattern; *p; p++) {
+      if (*p == '/') {
+        x = 0;
+        y++;
+        continue;
+      }
+      if (*p == '#') {
+        cells.push_back({x, y});
+      }
+      x++;
+    }
+    return cells;
+  }
+
+  // a key for an object that's the same under rotation and reflection: the
+  // smallest encoding of its eight orientations
+  static std::string canonicalise(const std::vector<Cell> &cells) {
+    std::string best;
+    std::vector<Cell> t(cells.size());
+    for (int orientation = 0; orientation < 8; orientation++) {
+      for (size_t i = 0; i < cells.size(); i++) {
+        int x = cells[i].first, y = cells[i].second;
+        if (orientation & 1) {
+          x = -x;
+        }
+        if (orientation & 2) {
+          y = -y;
+        }
+        if (orientation & 4) {
+          std::swap(x, y);
+        }
+        t[i] = {x, y};
+      }
+      const std::string key = encode(t);
+      if (best.empty() || key < best) {
+        best = key;
+      }
+    }
+    return best;
+  }
+
+  // encode cells as "WxH:" followed by each row as a hex bitmask; objects
+  // that span the board are never encoded, so a row fits in 64 bits
+  static std::string encode(const std::vector<Cell> &cells) {
+    int min_x = cells[0].first, min_y = cells[0].second;
+    int max_x = min_x, max_y = min_y;
+    for (const Cell &c : cells) {
+      min_x = std::min(min_x, c.first);
+      min_y = std::min(min_y, c.second);
+      max_x = std::max(max_x, c.first);
+      max_y = std::max(max_y, c.second);
+    }
+    const int w = max_x - min_x + 1, h = max_y - min_y + 1;
+    std::vector<uint64_t> rows(h, 0);
+    for (const Cell &c : cells) {
+      rows[c.second - min_y] |= uint64_t(1) << (c.first - min_x);
+    }
+    std::ostringstream os;
+    os << w << "x" << h << ":" << std::hex;
+    for (int y = 0; y < h; y++) {
+      os << (y ? "." : "") << rows[y];
+    }
+    return os.str();
+  }
+
+  // a group of live cells, with its coordinates unwrapped from the torus
+  struct Object {
+    std::vector<Cell> cells;
+
+    // the group wraps around the torus or spans the board, so its unwrapped
+    // coordinates don't describe its shape
+    bool wrapped;
+  };
+
+  // flood fill the live cells into groups of cells up to reach apart,
+  // unwrapping the coordinates of groups that straddle an edge of the torus
+  static std::vector<Object> fill(const Soup &soup,
+                                  const std::vector<uint8_t> &live,
+                                  int reach) {
+    const int cols = soup.cols, rows = soup.rows;
+    std::vector<uint8_t> seen(live.size(), 0);
+    std::vector<Cell> pos(live.size());
+    std::vector<Object> objects;
+    std::vector<Cell> stack;
+    for (int x = 0; x < cols; x++) {
+      for (int y = 0; y < rows; y++) {
+        if (!live[x * rows + y] || seen[x * rows + y]) {
+          continue;
+        }
+        objects.push_back({{}, false});
+        Object &object = objects.back();
+        seen[x * rows + y] = 1;
+        pos[x * rows + y] = {x, y};
+        stack.push_back({x, y});
+        while (!stack.empty()) {
+          const Cell c = stack.back();
+          stack.pop_back();
+          object.cells.push_back(c);
+          for (int dx = -reach; dx <= reach; dx++) {
+            for (int dy = -reach; dy <= reach; dy++) {
+              const int nx = c.first + dx, ny = c.second + dy;
+              const size_t i = ((nx % cols + cols) % cols) * rows +
+                               (ny % rows + rows) % rows;
+              if (!live[i]) {
+                continue;
+              }
+              if (!seen[i]) {
+                seen[i] = 1;
+                pos[i] = {nx, ny};
+                stack.push_back({nx, ny});
+              } else if (pos[i] != Cell{nx, ny}) {
+                // the group reached this cell again the other way around
+                object.wrapped = true;
+              }
+            }
+          }
+        }
+        if (spans(soup, object.cells)) {
+          object.wrapped = true;
+        }
+      }
+    }
+    return objects;
+  }
+
+  // does a group of cells reach across the whole board (or past what a row
+  // of the encoding can hold)?
+  static bool spans(const Soup &soup, const std::vector<Cell> &cells) {
+    int min_x = cells[0].first, min_y = cells[0].second;
+    int max_x = min_x, max_y = min_y;
+    for (const Cell &c : cells) {
+      min_x = std::min(min_x, c.first);
+      min_y = std::min(min_y, c.second);
+      max_x = std::max(max_x, c.first);
+      max_y = std::max(max_y, c.second);
+    }
+    const int w = max_x - min_x + 1, h = max_y - min_y + 1;
+    return w >= soup.cols || h >= soup.rows || std::max(w, h) > 64;
+  }
+
+  // split a soup into clusters of cells up to two apart, so oscillators that
+  // fall apart into separate pieces in one of their phases (beacon, toad)
+  // are kept whole
+  static std::vector<Object> clusters(const Soup &soup) {
+    return fill(soup, soup.world, 2);
+  }
+
+  // split a cluster into its 8-connected pieces; adjacency is worked out on
+  // the torus, and each piece is unwrapped on its own
+  static std::vector<Object> pieces(const Soup &soup, const Object &cluster) {
+    std::vector<uint8_t> live(soup.world.size(), 0);
+    for (const Cell &c : cluster.cells) {
+      live[((c.first % soup.cols + soup.cols) % soup.cols) * soup.rows +
+           (c.second % soup.rows + soup.rows) % soup.rows] = 1;
+    }
+    return fill(soup, live, 1);
+  }
+
+  // join two pieces into one object if any of their cells are up to two
+  // apart on the torus, lining up the coordinates of b with a
+  static bool join(const Soup &soup, const Object &a, const Object &b,
+                   Object &out) {
+    for (const Cell &ca : a.cells) {
+      for (const Cell &cb : b.cells) {
+        const int dx = delta(cb.first - ca.first, soup.cols);
+        const int dy = delta(cb.second - ca.second, soup.rows);
+        if (std::abs(dx) > 2 || std::abs(dy) > 2) {
+          continue;
+        }
+        const int sx = ca.first + dx - cb.first;
+        const int sy = ca.second + dy - cb.second;
+        out = {a.cells, false};
+        for (const Cell &c : b.cells) {
+          out.cells.push_back({c.first + sx, c.second + sy});
+        }
+        out.wrapped = spans(soup, out.cells);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // the shortest signed distance between two coordinates on a ring of size n
+  static int delta(int d, int n) {
+    d = (d % n + n) % n;
+    return d > n / 2 ? d - n : d;
+  }
+
+  // the name of a well known object, or nullptr
+  const std::string *known(const Object &object) const {
+    if (object.wrapped) {
+      return nullptr;
+    }
+    auto it = names_.find(canonicalise(object.cells));
+    return it == names_.end() ? nullptr : &it->second;
+  }
+
+  // the name of an object, or its canonical key if it isn't well known
+  std::string name(const Object &object) const {
+    if (const std::string *n = known(object)) {
+      return *n;
+    }
+    std::ostringstream os;
+    os << "xs" << object.cells.size() << "_";
+    if (object.wrapped) {
+      os << "torus";
+    } else {
+      os << canonicalise(object.cells);
+    }
+    return os.str();
+  }
+
+  void census(const Soup &soup) {
+    std::map<std::string, uint64_t> counts;
+    for (const auto &cluster : clusters(soup)) {
+      if (const std::string *n = known(cluster)) {
+        counts[*n]++;
+        continue;
+      }
+
+      // a cluster that isn't a known object is usually separate objects
+      // that happen to be close together; rejoin pairs of unknown pieces
+      // that make a known object, such as an oscillator that fell apart
+      // next to other ash
+      std::vector<Object> objects = pieces(soup, cluster);
+      for (size_t i = 0; i < objects.size(); i++) {
+        for (size_t j = i + 1; j < objects.size() && !known(objects[i]);
+             j++) {
+          Object joined;
+          if (!known(objects[j]) &&
+              join(soup, objects[i], objects[j], joined) && known(joined)) {
+            objects[i] = std::move(joined);
+            objects.erase(objects.begin() + j);
+          }
+        }
+      }
+      for (const auto &object : objects) {
+        counts[name(object)]++;
+      }
+    }
+
+    std::ostringstream os;
+    for (const auto &pr : counts) {
+      totals_[pr.first] += pr.second;
+      os << (os.tellp() ? ", " : "") << pr.second << " " << pr.first;
+    }
+    soups_++;
+    LOG_INFO("soup %lu settled after %lu generations: %s",
+             static_cast<unsigned long>(soups_),
+             static_cast<unsigned long>(soup.generations),
+             counts.empty() ? "empty" : os.str().c_str());
+    if (soups_ % kReportInterval == 0) {
+      report();
+    }
+  }
+
+  // log the totals across all soups, most common first
+  void report() const {
+    std::vector<std::pair<uint64_t, std::string>> sorted;
+    for (const auto &pr : totals_) {
+      sorted.push_back({pr.second, pr.first});
+    }
+    std::sort(sorted.rbegin(), sorted.rend());
+    LOG_INFO("census of %lu soups (%zu dropped):",
+             static_cast<unsigned long>(soups_),
+             dropped_.load(std::memory_order_relaxed));
+    for (const auto &pr : sorted) {
+      LOG_INFO("  %10lu %s", static_cast<unsigned long>(pr.first),
+               pr.second.c_str());
+    }
+  }
+
+  // census soups until the census is destroyed
+  void work() {
+    Soup soup;
+    for (;;) {
+      const bool stop = stop_.load(std::memory_order_acquire);
+      while (queue_.try_pop(soup)) {
+        census(soup);
+      }
+      if (stop) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+};
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Checkpoint keeps a copy of a trivially copyable value in a memory mapped
+// file, so it survives the process crashing or being restarted. The file has
+// two slots that are written alternately, each with a sequence number and a
+// checksum; a write that's cut short leaves the other slot intact.
+template <typename T> class Checkpoint {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "checkpointed values must be trivially copyable");
+
+public:
+  explicit Checkpoint(const std::string &path)
+      : path_(path), layout_(nullptr), seq_(0) {
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+      throw error("failed to open");
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 ||
+        (static_cast<size_t>(st.st_size) != sizeof(Layout) &&
+         ftruncate(fd, sizeof(Layout)) == -1)) {
+      close(fd);
+      throw error("failed to size");
+    }
+    void *addr = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw error("failed to mmap");
+    }
+    layout_ = static_cast<Layout *>(addr);
+
+    // start over if the file is new or was written by something else
+    Header &h = layout_->header;
+    if (std::memcmp(h.magic, kMagic, sizeof(h.magic)) != 0 ||
+        h.size != sizeof(T)) {
+      std::memset(layout_, 0, sizeof(Layout));
+      std::memcpy(h.magic, kMagic, sizeof(h.magic));
+      h.size = sizeof(T);
+    }
+    for (const Slot &slot : layout_->slots) {
+      if (valid(slot) && slot.seq > seq_) {
+        seq_ = slot.seq;
+      }
+    }
+  }
+
+  // delete copy ctor
+  Checkpoint(const Checkpoint &other) = delete;
+
+  ~Checkpoint() {
+    if (layout_ != nullptr) {
+      munmap(layout_, sizeof(Layout));
+    }
+  }
+
+  // load the most recently saved value; returns false if there isn't one
+  bool load(T &out) const {
+    for (const Slot &slot : layout_->slots) {
+      if (seq_ != 0 && slot.seq == seq_ && valid(slot)) {
+        std::memcpy(&out, &slot.val, sizeof(T));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // save a value; this is just a copy into the page cache unless sync is set,
+  // in which case writeback to disk is started too
+  void save(const T &val, bool sync = false) {
+    Slot &slot = layout_->slots[(seq_ + 1) % 2];
+    __atomic_store_n(&slot.seq, 0, __ATOMIC_RELEASE);
+    std::memcpy(&slot.val, &val, sizeof(T));
+    slot.checksum = checksum(slot.val);
+    __atomic_store_n(&slot.seq, ++seq_, __ATOMIC_RELEASE);
+    if (sync) {
+      msync(layout_, sizeof(Layout), MS_ASYNC);
+    }
+  }
+
+private:
+  static constexpr char kMagic[8] = {'m', 'o', 'n', 'o', 'c', 'k', 'p', '1'};
+
+  struct Header {
+    char magic[8];
+    uint64_t size;
+  };
+
+  struct Slot {
+    uint64_t seq;
+    uint64_t checksum;
+    T val;
+  };
+
+  struct Layout {
+    Header header;
+    Slot slots[2];
+  };
+
+  std::string path_;
+  Layout *layout_;
+  uint64_t seq_;
+
+  std::runtime_error error(const std::string &what) const {
+    return std::runtime_error(what + " checkpoint " + path_ + ": " +
+                              strerror(errno));
+  }
+
+  static bool valid(const Slot &slot) {
+    return slot.seq != 0 && slot.checksum == checksum(slot.val);
+  }
+
+  // FNV-1a
+  static uint64_t checksum(const T &val) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(&val);
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      h = (h ^ p[i]) * 1099511628211ull;
+    }
+    return h;
+  }
+};
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Ensemble runs many independent toroidal Life universes of the same size at
+// once. Each cell holds one bit per universe: bit i of word w belongs to
+// universe 64 * w + i. The words for a cell are contiguous and are stepped
+// four at a time as a 256-bit vector, i.e. 256 universes per operation; that's
+// one AVX2 register when built with -mavx2, and two SSE2 registers otherwise.
+class Ensemble {
+public:
+  static const int kLanes = 64;
+
+  // the number of words in a vector
+  static const size_t kVectorWords = 4;
+
+  Ensemble(int cols, int rows, size_t universes)
+      : cols_(cols), rows_(rows),
+        words_((universes + kLanes * kVectorWords - 1) /
+               (kLanes * kVectorWords) * kVectorWords),
+        universes_(universes), generation_(0),
+        cur_(cols * rows * words_, 0), prev_(cur_.size(), 0),
+        next_(cur_.size(), 0), lifespan_(universes, -1),
+        population_(universes, 0), settled_(words_, 0), moved_(words_, 0),
+        flipped_(words_, 0) {
+    // universes past the requested count are padding; they count as settled
+    for (size_t w = universes / kLanes; w < words_; w++) {
+      settled_[w] = ~uint64_t(0);
+    }
+    if (universes % kLanes) {
+      settled_[universes / kLanes] = ~uint64_t(0) << (universes % kLanes);
+    }
+
+    const int cells = cols * rows;
+    neighbors_.resize(cells * 8);
+    for (int x = 0; x < cols; x++) {
+      for (int y = 0; y < rows; y++) {
+        size_t *n = &neighbors_[(x * rows + y) * 8];
+        for (int dx = -1; dx <= 1; dx++) {
+          for (int dy = -1; dy <= 1; dy++) {
+            if (dx || dy) {
+              *n++ = ((x + dx + cols) % cols) * rows + (y + dy + rows) % rows;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // fill every universe with a random soup at 50% density
+  void randomize(uint64_t seed) {
+    std::mt19937_64 gen(seed);
+    for (auto &w : cur_) {
+      w = gen();
+    }
+    std::fill(prev_.begin(), prev_.end(), 0);
+    generation_ = 0;
+  }
+
+  // advance every universe by one generation, and record the universes that
+  // became still or period 2; returns true if every universe has settled
+  bool step() {
+    const size_t cells = cols_ * rows_;
+    std::fill(moved_.begin(), moved_.end(), 0);
+    std::fill(flipped_.begin(), flipped_.end(), 0);
+    for (size_t c = 0; c < cells; c++) {
+      const size_t *n = &neighbors_[c * 8];
+      const uint64_t *nb[8];
+      for (int k = 0; k < 8; k++) {
+        nb[k] = &cur_[n[k] * words_];
+      }
+      step_cell(words_, nb, &cur_[c * words_], &prev_[c * words_],
+                &next_[c * words_], moved_.data(), flipped_.data());
+    }
+    prev_.swap(cur_);
+    cur_.swap(next_);
+    generation_++;
+
+    bool done = true;
+    for (size_t w = 0; w < words_; w++) {
+      const uint64_t now = ~(moved_[w] & flipped_[w]) & ~settled_[w];
+      if (now) {
+        settle(w, now);
+      }
+      done = done && settled_[w] == ~uint64_t(0);
+    }
+    return done;
+  }
+
+  // run until every universe settles, or for at most max_generations
+  void run(int max_generations) {
+    while (generation_ < max_generations && !step())
+      ;
+    // record the population of the universes that never settled
+    for (size_t w = 0; w < words_; w++) {
+      if (~settled_[w]) {
+        count_population(w, ~settled_[w]);
+      }
+    }
+  }
+
+  size_t universes() const { return universes_; }
+
+  int generation() const { return generation_; }
+
+  // the generation a universe settled at, or -1 if it never did
+  int lifespan(size_t u) const { return lifespan_[u]; }
+
+  // the population of a universe when it settled
+  int population(size_t u) const { return population_[u]; }
+
+private:
+  typedef uint64_t Lanes __attribute__((vector_size(kVectorWords * 8)));
+
+  int cols_;
+  int rows_;
+  size_t words_;
+  size_t universes_;
+  int generation_;
+  std::vector<uint64_t> cur_;
+  std::vector<uint64_t> prev_;
+  std::vector<uint64_t> next_;
+  std::vector<size_t> neighbors_;
+  std::vector<int> lifespan_;
+  std::vector<int> population_;
+  std::vector<uint64_t> settled_;
+
+  // per word, the universes that changed since the last and second to last
+  // generation
+  std::vector<uint64_t> moved_;
+  std::vector<uint64_t> flipped_;
+
+  // compute the next generation of one cell in every universe, given the
+  // words of its eight neighbours, a vector of words at a time
+  static void step_cell(size_t words, const uint64_t *const (&nb)[8],
+                        const uint64_t *cur, const uint64_t *prev,
+                        uint64_t *next, uint64_t *moved, uint64_t *flipped) {
+    for (size_t w = 0; w < words; w += kVectorWords) {
+      // bit-sliced neighbour count; s2 is sticky once the count reaches 4
+      Lanes s0 = {0}, s1 = {0}, s2 = {0}, v, c, p;
+      for (int k = 0; k < 8; k++) {
+        load(v, nb[k] + w);
+        const Lanes c0 = s0 & v;
+        s0 ^= v;
+        s2 |= s1 & c0;
+        s1 ^= c0;
+      }
+      load(c, cur + w);
+      load(p, prev + w);
+      const Lanes out = ~s2 & s1 & (s0 | c);
+      store(next + w, out);
+      load(v, moved + w);
+      store(moved + w, v | (out ^ c));
+      load(v, flipped + w);
+      store(flipped + w, v | (out ^ p));
+    }
+  }
+
+  static void load(Lanes &v, const uint64_t *p) {
+    std::memcpy(&v, p, sizeof(v));
+  }
+
+  static void store(uint64_t *p, const Lanes &v) {
+    std::memcpy(p, &v, sizeof(v));
+  }
+
+  // record the universes in mask as settled at this generation
+  void settle(size_t w, uint64_t mask) {
+    settled_[w] |= mask;
+    for (int i = 0; i < kLanes; i++) {
+      if (mask >> i & 1) {
+        lifespan_[w * kLanes + i] = generation_;
+      }
+    }
+    count_population(w, mask);
+  }
+
+  // record the population of the universes in mask
+  void count_population(size_t w, uint64_t mask) {
+    const size_t cells = cols_ * rows_;
+    for (int i = 0; i < kLanes; i++) {
+      const size_t u = w * kLanes + i;
+      if (!(mask >> i & 1) || u >= universes_) {
+        continue;
+      }
+      int pop = 0;
+      for (size_t c = 0; c < cells; c++) {
+        pop += cur_[c * words_ + w] >> i & 1;
+      }
+      population_[u] = pop;
+    }
+  }
+};
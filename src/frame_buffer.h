@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "./board.h"
+
+// FrameBuffer is the desired LED state of a board. Apps draw into it, and the
+// host pushes only the LEDs that changed since the last flush to the board.
+class FrameBuffer {
+public:
+  FrameBuffer(int cols, int rows)
+      : cols_(cols), rows_(rows), frame_(cols * rows, 0),
+        shown_(cols * rows, 0), intensity_(-1) {}
+
+  int cols() const { return cols_; }
+  int rows() const { return rows_; }
+
+  // turn an led on or off
+  void set(int x, int y, bool on) { frame_[x * rows_ + y] = on; }
+
+  // is an led on?
+  bool get(int x, int y) const { return frame_[x * rows_ + y]; }
+
+  // turn all leds off
+  void clear() { std::fill(frame_.begin(), frame_.end(), 0); }
+
+  // copy a whole world, stored x * rows + y, into the frame
+  void draw(const std::vector<uint8_t> &cells) {
+    std::copy(cells.begin(), cells.end(), frame_.begin());
+  }
+
+  // the desired led state, stored x * rows + y
+  const std::vector<uint8_t> &frame() const { return frame_; }
+
+  // set the led intensity on the next flush
+  void set_intensity(int intensity) { intensity_ = intensity; }
+
+  // forget what the board is showing, e.g. after it was cleared externally
+  void invalidate(uint8_t val = 0) {
+    std::fill(shown_.begin(), shown_.end(), val);
+  }
+
+  // push the changed leds to the board, and flush them if it's buffered
+  void flush(const Board &board) {
+    if (intensity_ != -1) {
+      board.led_intensity(intensity_);
+      intensity_ = -1;
+    }
+    for (int x = 0; x < cols_; x++) {
+      for (int y = 0; y < rows_; y++) {
+        const size_t i = x * rows_ + y;
+        if (frame_[i] == shown_[i]) {
+          continue;
+        }
+        if (frame_[i]) {
+          board.led_on(x, y);
+        } else {
+          board.led_off(x, y);
+        }
+        shown_[i] = frame_[i];
+      }
+    }
+    board.flush();
+  }
+
+private:
+  int cols_;
+  int rows_;
+  std::vector<uint8_t> frame_;
+  std::vector<uint8_t> shown_;
+  int intensity_;
+};
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "./block_lut.h"
+#include "./profile.h"
+
+// The engine used to compute generations.
+enum class Engine {
+  NAIVE = 1,
+  LUT = 2,
+};
+
+// Life is a toroidal game of life world, shared by monolife and monod. Cells
+// are stored x * rows + y.
+class Life {
+public:
+  Life(int cols, int rows, Engine engine, Profiler &profiler)
+      : cols_(cols), rows_(rows), engine_(engine), generation_(0),
+        world_(cols * rows, 0), last_(cols * rows, 0), profiler_(profiler) {
+    if (engine_ == Engine::LUT && (rows_ % 2 || cols_ % 2)) {
+      throw std::runtime_error(
+          "the lut engine needs an even number of rows and columns");
+    }
+  }
+
+  // delete copy ctor
+  Life(const Life &other) = delete;
+
+  int cols() const { return cols_; }
+  int rows() const { return rows_; }
+
+  // the number of generations computed so far
+  uint64_t generation() const { return generation_; }
+
+  // the current generation
+  const std::vector<uint8_t> &world() const { return world_; }
+
+  // the previous generation
+  const std::vector<uint8_t> &last() const { return last_; }
+
+  // get ref to a coordinate with wraparound
+  uint8_t &at(int x, int y) { return at(x, y, world_); }
+
+  // flip a cell, returning its new value
+  bool toggle(int x, int y) {
+    uint8_t &val = at(x, y);
+    val = !val;
+    return val;
+  }
+
+  // fill the world with random cells
+  template <typename Generator> void randomize(Generator &gen) {
+    std::bernoulli_distribution dist(0.5);
+    for (auto &cell : world_) {
+      cell = dist(gen);
+    }
+  }
+
+  // compute the next generation
+  void step() {
+    if (engine_ == Engine::LUT) {
+      ScopedPhase phase(profiler_, "step.lut", world_.size());
+      lut_.step(world_, last_, cols_, rows_);
+    } else {
+      ScopedPhase phase(profiler_, "step.naive", world_.size());
+      for (int x = 0; x < cols_; x++) {
+        for (int y = 0; y < rows_; y++) {
+          at(x, y, last_) = life_rule(at(x, y), count_neighbors(x, y));
+        }
+      }
+    }
+    world_.swap(last_);
+    generation_++;
+  }
+
+private:
+  int cols_;
+  int rows_;
+  Engine engine_;
+  uint64_t generation_;
+  std::vector<uint8_t> world_;
+  std::vector<uint8_t> last_;
+  BlockLUT lut_;
+  Profiler &profiler_;
+
+  uint8_t &at(int x, int y, std::vector<uint8_t> &vec) {
+    if (x < 0) {
+      x += cols_;
+    } else if (x >= cols_) {
+      x -= cols_;
+    }
+    if (y < 0) {
+      y += rows_;
+    } else if (y >= rows_) {
+      y -= rows_;
+    }
+    return vec[x * rows_ + y];
+  }
+
+  size_t count_neighbors(int x, int y) {
+    size_t count = 0;
+    count += at(x - 1, y - 1);
+    count += at(x - 1, y);
+    count += at(x - 1, y + 1);
+    count += at(x, y - 1);
+    count += at(x, y + 1);
+    count += at(x + 1, y - 1);
+    count += at(x + 1, y);
+    count += at(x + 1, y + 1);
+    return count;
+  }
+};
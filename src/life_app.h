@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <monome.h>
+
+#include "./app.h"
+#include "./life.h"
+#include "./profile.h"
+
+// LifeApp is monolife as a monod app: keys toggle cells, and the top left key
+// starts and pauses the simulation.
+class LifeApp : public App {
+public:
+  LifeApp(int cols, int rows, int delay, Engine engine, Profiler &profiler)
+      : delay_(delay), started_(false), life_(cols, rows, engine, profiler) {}
+
+  const char *name() const override { return "life"; }
+
+  void activate(FrameBuffer &fb) override {
+    fb.draw(life_.world());
+    if (!started_) {
+      fb.set(0, 0, true);
+    }
+  }
+
+  void on_key(const monome_event_t *e, FrameBuffer &fb) override {
+    if (e->event_type != MONOME_BUTTON_DOWN) {
+      return;
+    }
+    const int x = e->grid.x;
+    const int y = e->grid.y;
+    if (x == 0 && y == 0) {
+      started_ = !started_;
+      fb.set(0, 0, !started_);
+      return;
+    }
+    fb.set(x, y, life_.toggle(x, y));
+  }
+
+  int step(FrameBuffer &fb) override {
+    if (!started_) {
+      return delay_;
+    }
+    life_.step();
+    fb.draw(life_.world());
+    return delay_;
+  }
+
+private:
+  int delay_;
+  bool started_;
+  Life life_;
+};
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <thread>
+#include <utility>
+
+#include "./ring_buffer.h"
+
+// the minimum level that's compiled in; calls below it are elided, including
+// their arguments
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 1
+#endif
+
+enum class LogLevel {
+  DEBUG = 0,
+  INFO = 1,
+  WARNING = 2,
+  ERROR = 3,
+};
+
+#define LOG_AT(level, ...)                                                     \
+  do {                                                                         \
+    if constexpr (static_cast<int>(level) >= LOG_LEVEL) {                      \
+      Logger::get().log(level, __VA_ARGS__);                                   \
+    }                                                                          \
+  } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LogLevel::ERROR, __VA_ARGS__)
+
+// Logger formats messages into an in-memory ring, and a background thread
+// writes them to stdout. Logging never blocks the caller: if the ring is full
+// the message is dropped and counted.
+class Logger {
+public:
+  // the longest message, including the level prefix; longer ones are
+  // truncated
+  static const size_t kMaxMessage = 240;
+
+  // the number of messages the ring holds
+  static const size_t kCapacity = 1024;
+
+  // the logger, started on first use and drained at exit
+  static Logger &get() {
+    static Logger logger;
+    return logger;
+  }
+
+  // delete copy ctor
+  Logger(const Logger &other) = delete;
+
+  ~Logger() {
+    stop_.store(true, std::memory_order_release);
+    thread_.join();
+  }
+
+  void log(LogLevel level, const char *fmt, ...)
+      __attribute__((format(printf, 3, 4))) {
+    Entry entry;
+    int n = std::snprintf(entry.msg, sizeof(entry.msg), "%s", prefix(level));
+    va_list ap;
+    va_start(ap, fmt);
+    const int m =
+        std::vsnprintf(entry.msg + n, sizeof(entry.msg) - n, fmt, ap);
+    va_end(ap);
+    if (m > 0) {
+      n += m;
+    }
+    entry.len = std::min<size_t>(n, sizeof(entry.msg) - 1);
+    if (!ring_.try_push(std::move(entry))) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  struct Entry {
+    size_t len;
+    char msg[kMaxMessage];
+  };
+
+  RingBuffer<Entry> ring_;
+  std::atomic<size_t> dropped_;
+  std::atomic<bool> stop_;
+  std::thread thread_;
+
+  Logger()
+      : ring_(kCapacity), dropped_(0), stop_(false),
+        thread_([this]() { drain(); }) {}
+
+  static const char *prefix(LogLevel level) {
+    switch (level) {
+    case LogLevel::DEBUG:
+      return "debug: ";
+    case LogLevel::INFO:
+      return "";
+    case LogLevel::WARNING:
+      return "warning: ";
+    case LogLevel::ERROR:
+      return "error: ";
+    }
+    return "";
+  }
+
+  // write out messages until the logger is destroyed
+  void drain() {
+    Entry entry;
+    for (;;) {
+      const bool stop = stop_.load(std::memory_order_acquire);
+      bool wrote = false;
+      while (ring_.try_pop(entry)) {
+        std::fwrite(entry.msg, 1, entry.len, stdout);
+        std::fputc('\n', stdout);
+        wrote = true;
+      }
+      const size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+      if (dropped) {
+        std::fprintf(stdout, "warning: dropped %zu log messages\n", dropped);
+        wrote = true;
+      }
+      if (wrote) {
+        std::fflush(stdout);
+      }
+      if (stop) {
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+};
@@ -0,0 +1,487 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <monome.h>
+
+#include "./app.h"
+#include "./board.h"
+#include "./frame_buffer.h"
+#include "./life.h"
+#include "./life_app.h"
+#include "./log.h"
+#include "./percolate_app.h"
+#include "./profile.h"
+#include "./shared_frame.h"
+#include "./util.h"
+
+// The default control socket.
+const char kDefaultSocket[] = "/tmp/monod.sock";
+
+// step timer callback
+static void step_cb(evutil_socket_t fd, short what, void *arg);
+
+// signal callback
+static void signal_cb(evutil_socket_t sig, short what, void *arg);
+
+// control socket callbacks
+static void accept_cb(evconnlistener *listener, evutil_socket_t fd,
+                      sockaddr *addr, int len, void *arg);
+static void control_read_cb(bufferevent *bev, void *arg);
+static void control_event_cb(bufferevent *bev, short what, void *arg);
+
+// Daemon owns the board and hosts the apps on a single libevent loop.
+class Daemon {
+public:
+  Daemon() = delete;
+  explicit Daemon(const std::string &device)
+      : board_(device), fb_(board_.cols(), board_.rows()), current_(0),
+        step_ev_(nullptr), listener_(nullptr), generation_(0) {
+    board_.init_libevent();
+    step_ev_ = evtimer_new(board_.base(), step_cb, this);
+    board_.set_event_fn([this](const monome_event_t *e) { on_key(e); });
+  }
+
+  // delete copy ctor
+  Daemon(const Daemon &other) = delete;
+
+  ~Daemon() {
+    if (listener_ != nullptr) {
+      evconnlistener_free(listener_);
+      unlink(socket_path_.c_str());
+    }
+    if (step_ev_ != nullptr) {
+      event_free(step_ev_);
+    }
+    for (event *ev : signal_evs_) {
+      event_free(ev);
+    }
+  }
+
+  // register an app; the chord cycles through apps in registration order
+  void add_app(std::unique_ptr<App> app) { apps_.push_back(std::move(app)); }
+
+  // listen for commands on a unix socket
+  void listen(const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+      throw std::runtime_error("socket path too long: " + path);
+    }
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    listener_ = evconnlistener_new_bind(
+        board_.base(), accept_cb, this,
+        LEV_OPT_CLOSE_ON_FREE | LEV_OPT_CLOSE_ON_EXEC, -1,
+        reinterpret_cast<sockaddr *>(&addr), sizeof(addr));
+    if (listener_ == nullptr) {
+      throw std::runtime_error("failed to listen on " + path);
+    }
+    socket_path_ = path;
+  }
+
+  // publish each frame to a shared memory segment
+  void enable_publishing(const std::string &name) {
+    publisher_ =
+        std::make_unique<FramePublisher>(name, board_.cols(), board_.rows());
+  }
+
+  // count hardware events per phase; the totals are printed on SIGUSR1, and
+  // when the daemon stops
+  void enable_profiling() {
+    profiler_.enable();
+    add_signal(SIGUSR1);
+  }
+
+  // run until SIGINT or SIGTERM, starting with the selected app
+  void run() {
+    if (apps_.empty()) {
+      throw std::runtime_error("no apps registered");
+    }
+    add_signal(SIGINT);
+    add_signal(SIGTERM);
+    board_.clear();
+    fb_.invalidate();
+    activate(current_);
+    board_.start_libevent();
+  }
+
+  // choose the app that run() starts with; returns false if there's no such
+  // app
+  bool select(const std::string &name) {
+    const size_t i = find(name);
+    if (i == apps_.size()) {
+      return false;
+    }
+    current_ = i;
+    return true;
+  }
+
+  // switch to the app with the given name; returns false if there's no such
+  // app
+  bool switch_to(const std::string &name) {
+    const size_t i = find(name);
+    if (i == apps_.size()) {
+      return false;
+    }
+    activate(i);
+    return true;
+  }
+
+  // switch to the next app
+  void next_app() { activate((current_ + 1) % apps_.size()); }
+
+  // run the active app
+  void step() {
+    const int delay = apps_[current_]->step(fb_);
+    generation_++;
+    show();
+    schedule(delay);
+  }
+
+  // handle a control command, returning the reply
+  std::string command(const std::string &line) {
+    std::istringstream is(line);
+    std::string cmd, arg;
+    is >> cmd >> arg;
+    if (cmd == "list") {
+      std::ostringstream os;
+      for (const auto &app : apps_) {
+        os << app->name() << "\n";
+      }
+      return os.str();
+    } else if (cmd == "current") {
+      return std::string(apps_[current_]->name()) + "\n";
+    } else if (cmd == "next") {
+      next_app();
+      return std::string("ok ") + apps_[current_]->name() + "\n";
+    } else if (cmd == "switch") {
+      if (switch_to(arg)) {
+        return "ok " + arg + "\n";
+      }
+      return "error: no such app: " + arg + "\n";
+    }
+    return "error: unknown command: " + cmd + "\n";
+  }
+
+  Board &board() { return board_; }
+
+  Profiler &profiler() { return profiler_; }
+
+private:
+  Board board_;
+  FrameBuffer fb_;
+  Profiler profiler_;
+  std::vector<std::unique_ptr<App>> apps_;
+  size_t current_;
+  event *step_ev_;
+  std::vector<event *> signal_evs_;
+  evconnlistener *listener_;
+  std::string socket_path_;
+  std::unique_ptr<FramePublisher> publisher_;
+  uint64_t generation_;
+
+  // corner keys that are down, but held back from the app in case they turn
+  // out to be part of a chord
+  std::set<std::pair<int, int>> held_;
+
+  // corner keys that completed a chord; their releases are swallowed
+  std::set<std::pair<int, int>> chorded_;
+
+  // push the frame buffer to the board, and publish it if publishing is
+  // enabled
+  void show() {
+    {
+      ScopedPhase phase(profiler_, "leds", fb_.frame().size());
+      fb_.flush(board_);
+    }
+    if (publisher_) {
+      publisher_->publish(fb_.frame(), generation_);
+    }
+  }
+
+  // the index of the app with the given name, or apps_.size() if there's no
+  // such app
+  size_t find(const std::string &name) const {
+    for (size_t i = 0; i < apps_.size(); i++) {
+      if (name == apps_[i]->name()) {
+        return i;
+      }
+    }
+    return apps_.size();
+  }
+
+  // handle a signal in signal_cb
+  void add_signal(int sig) {
+    event *ev = evsignal_new(board_.base(), sig, signal_cb, this);
+    if (ev == nullptr || evsignal_add(ev, nullptr) == -1) {
+      throw std::runtime_error("failed to add signal event");
+    }
+    signal_evs_.push_back(ev);
+  }
+
+  // make an app active, redrawing the board from its state
+  void activate(size_t i) {
+    current_ = i;
+    fb_.clear();
+    apps_[current_]->activate(fb_);
+    show();
+    LOG_INFO("active app: %s", apps_[current_]->name());
+    schedule(0);
+  }
+
+  // schedule the next step, or stop stepping if delay is negative
+  void schedule(int delay) {
+    evtimer_del(step_ev_);
+    if (delay >= 0) {
+      const timeval tv = {delay / 1000, (delay % 1000) * 1000};
+      evtimer_add(step_ev_, &tv);
+    }
+  }
+
+  // holding down both bottom corners switches to the next app
+  bool corner(const std::pair<int, int> &key) const {
+    return key.second == board_.rows() - 1 &&
+           (key.first == 0 || key.first == board_.cols() - 1);
+  }
+
+  // handle a key event; a corner key press only reaches the app once it's
+  // released without completing a chord
+  void on_key(const monome_event_t *e) {
+    const std::pair<int, int> key = {e->grid.x, e->grid.y};
+    if (!corner(key)) {
+      forward(e);
+      return;
+    }
+    if (e->event_type == MONOME_BUTTON_DOWN) {
+      held_.insert(key);
+      if (held_.size() == 2) {
+        chorded_.insert(held_.begin(), held_.end());
+        held_.clear();
+        next_app();
+      }
+    } else if (e->event_type == MONOME_BUTTON_UP) {
+      if (chorded_.erase(key)) {
+        return;
+      }
+      if (held_.erase(key)) {
+        monome_event_t down = *e;
+        down.event_type = MONOME_BUTTON_DOWN;
+        forward(&down);
+      }
+      forward(e);
+    }
+  }
+
+  // pass a key event to the active app
+  void forward(const monome_event_t *e) {
+    apps_[current_]->on_key(e, fb_);
+    try {
+      show();
+    } catch (const std::runtime_error &exc) {
+      // don't let exceptions unwind through libmonome
+      std::cerr << "fatal error: " << exc.what() << "\n";
+      event_base_loopbreak(board_.base());
+    }
+  }
+};
+
+// Print a fatal exception
+static inline void PrintFatalError(const std::runtime_error &exc) {
+  std::cerr << "fatal error: " << exc.what() << "\n";
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  int millis = 100, intensity = 8;
+  double threshold = 0.;
+  bool buffered = false, profile = false;
+  Engine engine = Engine::NAIVE;
+  std::string checkpoint, device, shm, app = "life", socket = kDefaultSocket;
+  while ((opt = getopt(argc, argv, "a:bc:d:e:i:m:pS:s:t:")) != -1) {
+    switch (opt) {
+    case 'a':
+      app = optarg;
+      break;
+    case 'b':
+      buffered = true;
+      break;
+    case 'c':
+      checkpoint = optarg;
+      break;
+    case 'd':
+      device = optarg;
+      break;
+    case 'e':
+      if (std::strcmp(optarg, "naive") == 0) {
+        engine = Engine::NAIVE;
+      } else if (std::strcmp(optarg, "lut") == 0) {
+        engine = Engine::LUT;
+      } else {
+        std::cerr << "unknown engine: " << optarg << "\n";
+        return 1;
+      }
+      break;
+    case 'i':
+      intensity = std::stod(optarg);
+      break;
+    case 'm':
+      shm = optarg;
+      break;
+    case 'p':
+      profile = true;
+      break;
+    case 'S':
+      socket = optarg;
+      break;
+    case 's':
+      millis = std::stoi(optarg);
+      break;
+    case 't':
+      threshold = std::stod(optarg);
+      break;
+    default: /* '?' */
+      std::cerr << "Usage: " << argv[0]
+                << " [-a APP] [-b] [-c CHECKPOINT] [-d DEVICE] [-e naive|lut] "
+                   "[-i INTENSITY] [-m SHM] [-p] [-S SOCKET] "
+                   "[-s SLEEPMILLIS] [-t THRESHOLD]\n";
+      return 1;
+    }
+  }
+
+  try {
+    Daemon daemon(device);
+    Board &board = daemon.board();
+    if (buffered) {
+      board.enable_buffering();
+    }
+    daemon.add_app(std::make_unique<ClearApp>());
+    daemon.add_app(std::make_unique<LifeApp>(board.cols(), board.rows(),
+                                             millis, engine,
+                                             daemon.profiler()));
+    auto percolate = std::make_unique<PercolateApp>(
+        board.cols(), board.rows(), millis, threshold, daemon.profiler());
+    if (!checkpoint.empty() &&
+        percolate->percolation().enable_checkpoint(checkpoint)) {
+      LOG_INFO("resumed from checkpoint %s", checkpoint.c_str());
+    }
+    daemon.add_app(std::move(percolate));
+    if (!daemon.select(app)) {
+      std::cerr << "no such app: " << app << "\n";
+      return 1;
+    }
+    if (intensity) {
+      board.led_intensity(intensity);
+    }
+    if (!socket.empty()) {
+      daemon.listen(socket);
+    }
+    if (!shm.empty()) {
+      daemon.enable_publishing(shm);
+    }
+    if (profile) {
+      daemon.enable_profiling();
+    }
+    daemon.run();
+  } catch (std::runtime_error &exc) {
+    PrintFatalError(exc);
+    return 1;
+  }
+  return 0;
+}
+
+static void step_cb(evutil_socket_t fd, short what, void *arg) {
+  UNUSED(fd);
+  UNUSED(what);
+  Daemon *daemon = reinterpret_cast<Daemon *>(arg);
+  try {
+    daemon->step();
+  } catch (const std::runtime_error &exc) {
+    PrintFatalError(exc);
+    event_base_loopbreak(daemon->board().base());
+  }
+}
+
+static void signal_cb(evutil_socket_t sig, short what, void *arg) {
+  UNUSED(what);
+  Daemon *daemon = reinterpret_cast<Daemon *>(arg);
+  if (sig == SIGUSR1) {
+    daemon->profiler().report();
+  } else {
+    event_base_loopbreak(daemon->board().base());
+  }
+}
+
+static void accept_cb(evconnlistener *listener, evutil_socket_t fd,
+                      sockaddr *addr, int len, void *arg) {
+  UNUSED(addr);
+  UNUSED(len);
+  bufferevent *bev = bufferevent_socket_new(
+      evconnlistener_get_base(listener), fd, BEV_OPT_CLOSE_ON_FREE);
+  if (bev == nullptr) {
+    close(fd);
+    return;
+  }
+  bufferevent_setcb(bev, control_read_cb, nullptr, control_event_cb, arg);
+  bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+static void control_read_cb(bufferevent *bev, void *arg) {
+  Daemon *daemon = reinterpret_cast<Daemon *>(arg);
+  evbuffer *input = bufferevent_get_input(bev);
+  char *line;
+  size_t len;
+  while ((line = evbuffer_readln(input, &len, EVBUFFER_EOL_ANY)) != nullptr) {
+    std::string reply;
+    try {
+      reply = daemon->command(std::string(line, len));
+    } catch (const std::runtime_error &exc) {
+      reply = std::string("error: ") + exc.what() + "\n";
+    }
+    free(line);
+    bufferevent_write(bev, reply.data(), reply.size());
+  }
+}
+
+static void control_event_cb(bufferevent *bev, short what, void *arg) {
+  UNUSED(arg);
+  if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+    bufferevent_free(bev);
+  }
+}
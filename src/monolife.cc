@@ -15,40 +15,65 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <csignal>
 #include <cstddef>
 #include <cstring>
 
 #include <chrono>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include <unistd.h>
 
 #include <monome.h>
 
+#include "./block_lut.h"
+#include "./census.h"
+#include "./ensemble.h"
+#include "./life.h"
+#include "./profile.h"
+#include "./serial_transport.h"
+#include "./shared_frame.h"
+#include "./util.h"
+
 // The default device to use.
 const char kDefaultDevice[] = "/dev/ttyUSB0";
 
+// Set by SIGINT and SIGTERM in soup mode, polled from the main loop.
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_stop_signal(int sig) {
+  UNUSED(sig);
+  stop_requested = 1;
+}
+
+// Open the device, exiting if it can't be opened.
+static monome_t *OpenDevice(const std::string &device) {
+  monome_t *m = monome_open(device.c_str());
+  if (m == nullptr) {
+    exit(EXIT_FAILURE);
+  }
+  return m;
+}
+
 class State {
 public:
   State() = delete;
-  State(const std::string &device, int delay) : started_(false), delay_(delay) {
-    m_ = monome_open(device.c_str());
-    if (m_ == nullptr) {
-      exit(EXIT_FAILURE);
-    }
+  State(const std::string &device, int delay, Engine engine)
+      : m_(OpenDevice(device)), started_(false), delay_(delay),
+        life_(monome_get_cols(m_), monome_get_rows(m_), engine, profiler_),
+        gen_(std::random_device()()), max_generations_(0),
+        soup_generation_(0) {
     clear();
 
 #if 0
     std::cout << "device has " << rows() << " rows, " << cols() << " cols\n";
 #endif
-    const size_t sz = rows() * cols();
-    world_a_.resize(sz, 0);
-    world_b_.resize(sz, 0);
-    active_ = &world_a_;
 
     auto OnPress = [](const monome_event_t *e, void *data) {
       State *state = reinterpret_cast<State *>(data);
@@ -64,14 +89,13 @@ public:
             state->start();
           }
         }
-        uint8_t &val = state->at(x, y);
-        if (val) {
-          val = 0;
-          state->led_off(x, y);
-        } else {
-          val = 1;
+        if (state->life().toggle(x, y)) {
           state->led_on(x, y);
+        } else {
+          state->led_off(x, y);
         }
+        state->flush();
+        state->publish();
       }
     };
 
@@ -97,35 +121,33 @@ public:
 
     for (;;) {
       poll_events();
+      profiler_.poll();
+      if (profiler_.exit_requested() || stop_requested) {
+        force_stop();
+      }
       if (started_) {
-        bool a_active = active_ == &world_a_;
-        std::vector<uint8_t> &other = a_active ? world_b_ : world_a_;
-
-        // update other vector
-        for (int i = 0; i < cols(); i++) {
-          for (int j = 0; j < rows(); j++) {
-            size_t nn = count_neighbors(i, j);
-            bool live = at(i, j);
-            if (live && (nn == 2 || nn == 3)) {
-              other[i * cols() + j] = 1;
-            } else if (!live && nn == 3) {
-              other[i * cols() + j] = 1;
-            } else {
-              other[i * cols() + j] = 0;
+        life_.step();
+
+        {
+          const std::vector<uint8_t> &world = life_.world();
+          const std::vector<uint8_t> &last = life_.last();
+          ScopedPhase phase(profiler_, "leds", world.size());
+          for (int x = 0; x < cols(); x++) {
+            for (int y = 0; y < rows(); y++) {
+              const size_t i = x * rows() + y;
+              if (last[i] && !world[i]) {
+                led_off(x, y);
+              } else if (!last[i] && world[i]) {
+                led_on(x, y);
+              }
             }
           }
+          flush();
         }
-
-        for (int x = 0; x < cols(); x++) {
-          for (int y = 0; y < rows(); y++) {
-            if (at(x, y) && !at(x, y, other)) {
-              led_off(x, y);
-            } else if (!at(x, y) && at(x, y, other)) {
-              led_on(x, y);
-            }
-          }
+        publish();
+        if (census_) {
+          soup_step();
         }
-        active_ = a_active ? &world_b_ : &world_a_;
       }
 
       std::this_thread::sleep_for(std::chrono::milliseconds(delay_));
@@ -134,8 +156,15 @@ public:
 
   void pause() { started_ = false; }
 
-  // hack to force break ot of event loop
+  // hack to force break ot of event loop; exit() skips destructors, so the
+  // census and profiler report here
   void force_stop() {
+    if (census_) {
+      census_->stop();
+    }
+    if (profiler_.enabled()) {
+      profiler_.report();
+    }
     clear();
     close(monome_get_fd(m_));
     exit(EXIT_SUCCESS);
@@ -143,88 +172,278 @@ public:
 
   bool started() const { return started_; }
 
-  uint8_t &at(int x, int y, std::vector<uint8_t> &vec) {
-    const int c = cols();
-    if (x < 0) {
-      x += c;
-    } else if (x >= c) {
-      x -= c;
+  Life &life() { return life_; }
+
+  void led_on(int x, int y) {
+    if (transport_) {
+      transport_->led_on(x, y);
+    } else {
+      monome_led_on(m_, x, y);
     }
+  }
 
-    const int r = rows();
-    if (y < 0) {
-      y += r;
-    } else if (y >= r) {
-      y -= r;
+  void led_off(int x, int y) {
+    if (transport_) {
+      transport_->led_off(x, y);
+    } else {
+      monome_led_off(m_, x, y);
     }
-    return vec[x * c + y];
   }
 
-  uint8_t &at(int x, int y) { return at(x, y, *active_); }
+  void led_intensity(unsigned int brightness) {
+    if (transport_) {
+      transport_->led_intensity(brightness);
+      flush();
+    } else {
+      monome_led_intensity(m_, brightness);
+    }
+  }
 
-  size_t count_neighbors(int x, int y) {
-    size_t count = 0;
-    count += at(x - 1, y - 1);
-    count += at(x - 1, y);
-    count += at(x - 1, y + 1);
-    count += at(x, y - 1);
-    count += at(x, y + 1);
-    count += at(x + 1, y - 1);
-    count += at(x + 1, y);
-    count += at(x + 1, y + 1);
-    return count;
+  // buffer led commands and write them out once per generation
+  void enable_buffering() {
+    transport_ = std::make_unique<SerialTransport>(m_);
+  }
+
+  // write out buffered led commands, if buffering is enabled
+  void flush() {
+    if (!transport_) {
+      return;
+    }
+    try {
+      transport_->flush();
+    } catch (const std::runtime_error &exc) {
+      std::cerr << "fatal error: " << exc.what() << "\n";
+      exit(EXIT_FAILURE);
+    }
   }
 
-  void led_on(int x, int y) { monome_led_on(m_, x, y); }
+  Profiler &profiler() { return profiler_; }
 
-  void led_off(int x, int y) { monome_led_off(m_, x, y); }
+  // run random soups until they settle, and census what they leave behind;
+  // SIGINT and SIGTERM stop the run and report the totals
+  void enable_soups(int max_generations) {
+    max_generations_ = max_generations;
+    census_ = std::make_unique<Census>();
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    new_soup();
+  }
 
-  void led_intensity(unsigned int brightness) {
-    monome_led_intensity(m_, brightness);
+  // publish each generation to a shared memory segment
+  void enable_publishing(const std::string &name) {
+    publisher_ = std::make_unique<FramePublisher>(name, cols(), rows());
+    publish();
+  }
+
+  // publish the current world, if publishing is enabled
+  void publish() {
+    if (publisher_) {
+      publisher_->publish(life_.world(), life_.generation());
+    }
   }
 
 private:
   monome_t *m_;
   bool started_;
   int delay_;
-  std::vector<uint8_t> world_a_;
-  std::vector<uint8_t> world_b_;
-  std::vector<uint8_t> *active_;
-
-  void clear() { monome_led_all(m_, 0); }
+  Profiler profiler_;
+  Life life_;
+  std::unique_ptr<FramePublisher> publisher_;
+  std::unique_ptr<SerialTransport> transport_;
+
+  // soup mode state
+  std::mt19937 gen_;
+  int max_generations_;
+  uint64_t soup_generation_;
+  std::vector<uint8_t> prev_;
+  std::unique_ptr<Census> census_;
+
+  void clear() {
+    if (transport_) {
+      transport_->led_all(0);
+      flush();
+    } else {
+      monome_led_all(m_, 0);
+    }
+  }
 
   void poll_events() {
     while (monome_event_handle_next(m_))
       ;
   }
+
+  // start a new random soup, redrawing the board
+  void new_soup() {
+    life_.randomize(gen_);
+    prev_.assign(life_.world().size(), 0);
+    soup_generation_ = 0;
+
+    clear();
+    for (int x = 0; x < cols(); x++) {
+      for (int y = 0; y < rows(); y++) {
+        if (life_.at(x, y)) {
+          led_on(x, y);
+        }
+      }
+    }
+    flush();
+    publish();
+  }
+
+  // hand the soup to the census once it's still or period 2, or has run for
+  // too long
+  void soup_step() {
+    const std::vector<uint8_t> &world = life_.world();
+    soup_generation_++;
+    if (world == life_.last() || world == prev_ ||
+        soup_generation_ >= static_cast<uint64_t>(max_generations_)) {
+      census_->submit({cols(), rows(), soup_generation_, world});
+      new_soup();
+      return;
+    }
+    prev_ = life_.last();
+  }
 };
 
+// Run a headless ensemble of random soups, printing the lifespan and final
+// population of each universe.
+static void RunEnsemble(int cols, int rows, size_t universes,
+                        int generations) {
+  Ensemble ensemble(cols, rows, universes);
+  ensemble.randomize(std::random_device()());
+  ensemble.run(generations);
+
+  size_t unsettled = 0;
+  double lifespan = 0, population = 0;
+  std::cout << "universe lifespan population\n";
+  for (size_t u = 0; u < ensemble.universes(); u++) {
+    std::cout << u << " " << ensemble.lifespan(u) << " "
+              << ensemble.population(u) << "\n";
+    if (ensemble.lifespan(u) == -1) {
+      unsettled++;
+    } else {
+      lifespan += ensemble.lifespan(u);
+    }
+    population += ensemble.population(u);
+  }
+
+  const size_t settled = universes - unsettled;
+  std::cout << "# " << universes << " universes of " << cols << "x" << rows
+            << ", " << ensemble.generation() << " generations, " << unsettled
+            << " unsettled, mean lifespan "
+            << (settled ? lifespan / settled : 0.) << ", mean population "
+            << population / universes << "\n";
+}
+
 int main(int argc, char **argv) {
   int opt;
   int millis = 100, intensity = 0;
-  std::string device = kDefaultDevice;
-  while ((opt = getopt(argc, argv, "i:d:t:")) != -1) {
+  int ensemble = 0, generations = 1000, ensemble_cols = 16, ensemble_rows = 8;
+  bool buffered = false, profile = false, soups = false, verify = false;
+  Engine engine = Engine::NAIVE;
+  std::string device = kDefaultDevice, shm;
+  while ((opt = getopt(argc, argv, "bi:d:E:e:g:m:pSt:Vx:y:")) != -1) {
     switch (opt) {
+    case 'b':
+      buffered = true;
+      break;
     case 'd':
       device = optarg;
       break;
+    case 'E':
+      ensemble = std::stoi(optarg);
+      break;
+    case 'e':
+      if (std::strcmp(optarg, "naive") == 0) {
+        engine = Engine::NAIVE;
+      } else if (std::strcmp(optarg, "lut") == 0) {
+        engine = Engine::LUT;
+      } else {
+        std::cerr << "unknown engine: " << optarg << "\n";
+        return 1;
+      }
+      break;
+    case 'g':
+      generations = std::stoi(optarg);
+      break;
     case 'i':
       intensity = std::stod(optarg);
       break;
+    case 'm':
+      shm = optarg;
+      break;
+    case 'p':
+      profile = true;
+      break;
+    case 'S':
+      soups = true;
+      break;
     case 't':
       millis = std::stoi(optarg);
       break;
+    case 'V':
+      verify = true;
+      break;
+    case 'x':
+      ensemble_cols = std::stoi(optarg);
+      break;
+    case 'y':
+      ensemble_rows = std::stoi(optarg);
+      break;
     default: /* '?' */
       std::cerr << "Usage: " << argv[0]
-                << " [-d DEVICE] [-i INTENSITY] [-t MILLIS]\n";
+                << " [-b] [-d DEVICE] [-e naive|lut] [-g GENERATIONS] "
+                   "[-i INTENSITY] [-m SHM] [-p] [-S] [-t MILLIS] [-V]\n"
+                << "       " << argv[0]
+                << " -E UNIVERSES [-g GENERATIONS] [-x COLS] [-y ROWS]\n";
       return 1;
     }
   }
 
-  State state(device, millis);
-  if (intensity) {
-    state.led_intensity(intensity);
+  // run random soups headless, without a device
+  if (ensemble > 0) {
+    RunEnsemble(ensemble_cols, ensemble_rows, ensemble, generations);
+    return 0;
+  }
+
+  // check the lut engine against the rules for the common grid sizes
+  if (verify) {
+    BlockLUT lut;
+    for (const auto &dims : {std::make_pair(8, 8), std::make_pair(16, 8),
+                             std::make_pair(16, 16)}) {
+      if (!lut.verify(dims.first, dims.second, 100, 50)) {
+        std::cerr << "lut engine disagrees with the rules on a "
+                  << dims.first << "x" << dims.second << " world\n";
+        return 1;
+      }
+    }
+    std::cout << "lut engine ok\n";
+    return 0;
+  }
+
+  try {
+    State state(device, millis, engine);
+    if (buffered) {
+      state.enable_buffering();
+    }
+    if (intensity) {
+      state.led_intensity(intensity);
+    }
+    if (!shm.empty()) {
+      state.enable_publishing(shm);
+    }
+    if (profile) {
+      state.profiler().enable();
+    }
+    if (soups) {
+      state.enable_soups(generations);
+      state.start();
+    } else {
+      state.run();
+    }
+  } catch (const std::runtime_error &exc) {
+    std::cerr << "fatal error: " << exc.what() << "\n";
+    return 1;
   }
-  state.run();
   return 0;
 }
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "./shared_frame.h"
+
+// Draw a frame to the terminal.
+static void Draw(const Frame &frame) {
+  std::ostringstream os;
+  os << "\x1b[H\x1b[2J";
+  os << "generation " << frame.generation << "  population "
+     << frame.population;
+  for (const auto &stat : frame.stats) {
+    os << "  " << stat.first << " " << stat.second;
+  }
+  os << "\n";
+  for (int y = 0; y < frame.rows; y++) {
+    for (int x = 0; x < frame.cols; x++) {
+      os << (frame.cells[x * frame.rows + y] ? "# " : ". ");
+    }
+    os << "\n";
+  }
+  std::cout << os.str() << std::flush;
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  int millis = 50;
+  while ((opt = getopt(argc, argv, "t:")) != -1) {
+    switch (opt) {
+    case 't':
+      millis = std::stoi(optarg);
+      break;
+    default: /* '?' */
+      std::cerr << "Usage: " << argv[0] << " [-t MILLIS] NAME\n";
+      return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    std::cerr << "Usage: " << argv[0] << " [-t MILLIS] NAME\n";
+    return 1;
+  }
+
+  try {
+    FrameReader reader(argv[optind]);
+    Frame frame;
+    uint32_t seq = 1;
+    for (;;) {
+      if (reader.seq() != seq) {
+        seq = reader.seq();
+        if (reader.read(frame)) {
+          Draw(frame);
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+    }
+  } catch (const std::runtime_error &exc) {
+    std::cerr << "fatal error: " << exc.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -15,32 +15,26 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include <cstddef>
-#include <cstring>
+#include <cstdint>
 
-#include <chrono>
 #include <iostream>
-#include <random>
-#include <set>
+#include <memory>
 #include <string>
-#include <vector>
 
 #include <unistd.h>
 
 #include <monome.h>
 
 #include "./board.h"
+#include "./frame_buffer.h"
+#include "./log.h"
+#include "./percolation.h"
 #include "./persistent_mutable_timer.h"
+#include "./profile.h"
 #include "./running_average.h"
+#include "./shared_frame.h"
 #include "./util.h"
 
-enum class State {
-  GENERATE = 1,
-  STEP = 2,
-  VICTORY = 3,
-  FAIL = 4,
-};
-
 // step callback
 static void step_cb(evutil_socket_t fd, short what, void *arg);
 
@@ -48,110 +42,62 @@ static void step_cb(evutil_socket_t fd, short what, void *arg);
 class BoardState {
 public:
   BoardState() = delete;
-  explicit BoardState(const std::string &device)
-      : board_(device), state_(State::GENERATE), gen_(std::random_device()()),
-        dist_(0., 1.) {
-    world_.resize(board_.rows() * board_.cols());
-
+  BoardState(const std::string &device, double threshold)
+      : board_(device), fb_(board_.cols(), board_.rows()),
+        percolation_(board_.cols(), board_.rows(), threshold, profiler_),
+        generation_(0) {
     // set a callback to handle button down events
     board_.set_event_fn([this](const monome_event_t *event) {
       if (event->event_type == MONOME_BUTTON_DOWN) {
-        std::cout << "DOWN event at " << event->grid.x << " " << event->grid.y
-                  << "\n";
+        LOG_DEBUG("DOWN event at %u %u", event->grid.x, event->grid.y);
         const int brightness = 16 * event->grid.y / board_.rows();
-        std::cout << "setting brightness to " << brightness << "\n";
+        LOG_INFO("setting brightness to %d", brightness);
         board_.led_intensity(brightness);
 
         const int delay = 25 * (1 + event->grid.x);
-        std::cout << "setting delay to " << delay << "\n";
+        LOG_INFO("setting delay to %d", delay);
         timer_.UpdateTimeout(delay);
       }
     });
   }
 
   void step() {
-    switch (state_) {
-    case State::GENERATE:
-      std::cout << "step=" << threshold_.count()
-                << " threshold=" << threshold_.val() << "\n";
-      generate();
-      state_ = State::STEP;
-      break;
-    case State::STEP:
-      simulate_step();
-      break;
-    case State::VICTORY:
-    case State::FAIL:
-      state_ = State::GENERATE;
-      break;
+    percolation_.step();
+    {
+      ScopedPhase phase(profiler_, "leds", percolation_.world().size());
+      fb_.draw(percolation_.world());
+      fb_.flush(board_);
     }
-
-    timer_.Reschedule();
-  }
-
-  // generate a new board state
-  void generate() {
-    clear();
-    std::fill(world_.begin(), world_.end(), 0);
-    for (int i = 0; i < board_.cols(); i++) {
-      for (int j = 0; j < board_.rows(); j++) {
-        if (dist_(gen_) < threshold_.val()) {
-          at(i, j) = 1;
-          board_.led_on(i, j);
-        }
-      }
+    if (publisher_) {
+      const RunningAverage &threshold = percolation_.threshold();
+      publisher_->publish(percolation_.world(), ++generation_,
+                          {{"threshold", threshold.val()},
+                           {"trials", threshold.count()}});
     }
 
-    // set up the next set of leds
-    next_.clear();
-    for (int j = 0; j < board_.rows(); j++) {
-      if (off(0, j)) {
-        next_.insert({0, j});
-      }
+    profiler_.poll();
+    if (profiler_.exit_requested()) {
+      event_base_loopbreak(board_.base());
+      return;
     }
+    timer_.Reschedule();
   }
 
-  void simulate_step() {
-    bool reached_end = false;
-    for (const auto &pr : next_) {
-      board_.led_on(pr.first, pr.second);
-      at(pr.first, pr.second) = 1;
-      if (pr.first == board_.cols() - 1) {
-        reached_end = true;
-      }
-    }
-
-    std::set<std::pair<int, int>> new_next;
-    for (const auto &pr : next_) {
-      if (off(pr.first - 1, pr.second)) {
-        new_next.insert({pr.first - 1, pr.second});
-      }
-      if (off(pr.first + 1, pr.second)) {
-        new_next.insert({pr.first + 1, pr.second});
-      }
-      if (off(pr.first, pr.second - 1)) {
-        new_next.insert({pr.first, pr.second - 1});
-      }
-      if (off(pr.first, pr.second + 1)) {
-        new_next.insert({pr.first, pr.second + 1});
-      }
-    }
-
-    if (reached_end) {
-      state_ = State::VICTORY;
-      threshold_.update(1);
-    } else if (new_next.empty()) {
-      state_ = State::FAIL;
-      threshold_.update(0);
-    } else {
-      next_ = new_next;
-    }
+  // publish each step to a shared memory segment
+  void enable_publishing(const std::string &name) {
+    publisher_ =
+        std::make_unique<FramePublisher>(name, board_.cols(), board_.rows());
   }
 
-  // set the density threshold
-  void set_threshold(const RunningAverage &avg) { threshold_ = avg; }
+  // checkpoint state to a file, resuming from it if it's valid; returns true
+  // if the state was restored
+  bool enable_checkpoint(const std::string &path) {
+    return percolation_.enable_checkpoint(path);
+  }
 
   void run(int millis) {
+    board_.clear();
+    fb_.invalidate();
     board_.init_libevent();
     timer_ = PersistentMutableTimer(board_.base(), step_cb, this, millis);
     board_.start_libevent();
@@ -159,48 +105,16 @@ public:
 
   Board &board() { return board_; }
 
+  Profiler &profiler() { return profiler_; }
+
 private:
   Board board_;
-  State state_;
-  std::set<std::pair<int, int>> next_;
-  RunningAverage threshold_;
-  std::vector<uint8_t> world_;
+  FrameBuffer fb_;
+  Profiler profiler_;
+  Percolation percolation_;
   PersistentMutableTimer timer_;
-
-  std::default_random_engine gen_;
-  std::uniform_real_distribution<double> dist_;
-
-  // clear all leds on the board
-  void clear(int value = 0) { board_.led_all(value); }
-
-  // is a light off?
-  bool off(int x, int y) {
-    if (x < 0 || y < 0) {
-      return false;
-    }
-    if (x >= board_.cols() || y >= board_.rows()) {
-      return false;
-    }
-    return world_[x * board_.rows() + y] == 0;
-  }
-
-  // get ref to a coordinate with wraparound
-  uint8_t &at(int x, int y) {
-    const int c = board_.cols();
-    if (x < 0) {
-      x += c;
-    } else if (x >= c) {
-      x -= c;
-    }
-
-    const int r = board_.rows();
-    if (y < 0) {
-      y += r;
-    } else if (y >= r) {
-      y -= r;
-    }
-    return world_[x * r + y];
-  }
+  std::unique_ptr<FramePublisher> publisher_;
+  uint64_t generation_;
 };
 
 // Print a fatal exception
@@ -212,15 +126,28 @@ int main(int argc, char **argv) {
   int opt;
   int millis = 100, intensity = 8;
   double threshold = 0.;
-  std::string device;
-  while ((opt = getopt(argc, argv, "i:d:s:t:")) != -1) {
+  bool buffered = false, profile = false;
+  std::string checkpoint, device, shm;
+  while ((opt = getopt(argc, argv, "bc:i:d:m:ps:t:")) != -1) {
     switch (opt) {
+    case 'b':
+      buffered = true;
+      break;
+    case 'c':
+      checkpoint = optarg;
+      break;
     case 'd':
       device = optarg;
       break;
     case 'i':
       intensity = std::stod(optarg);
       break;
+    case 'm':
+      shm = optarg;
+      break;
+    case 'p':
+      profile = true;
+      break;
     case 's':
       millis = std::stoi(optarg);
       break;
@@ -228,19 +155,30 @@ int main(int argc, char **argv) {
       threshold = std::stod(optarg);
       break;
     default: /* '?' */
-      std::cerr
-          << "Usage: " << argv[0]
-          << "[-d DEVICE] [-i INTENSITY] [-s SLEEPMILLIS] [-t THRESHOLD]\n";
+      std::cerr << "Usage: " << argv[0]
+                << " [-b] [-c CHECKPOINT] [-d DEVICE] [-i INTENSITY] "
+                   "[-m SHM] [-p] [-s SLEEPMILLIS] [-t THRESHOLD]\n";
       return 1;
     }
   }
 
   try {
-    BoardState state(device);
+    BoardState state(device, threshold);
+    if (buffered) {
+      state.board().enable_buffering();
+    }
     if (intensity) {
       state.board().led_intensity(intensity);
     }
-    state.set_threshold(RunningAverage(threshold));
+    if (!shm.empty()) {
+      state.enable_publishing(shm);
+    }
+    if (!checkpoint.empty() && state.enable_checkpoint(checkpoint)) {
+      LOG_INFO("resumed from checkpoint %s", checkpoint.c_str());
+    }
+    if (profile) {
+      state.profiler().enable();
+    }
     state.run(millis);
   } catch (std::runtime_error &exc) {
     PrintFatalError(exc);
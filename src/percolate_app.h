@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <monome.h>
+
+#include "./app.h"
+#include "./percolation.h"
+#include "./profile.h"
+
+// PercolateApp is percolate as a monod app: the x coordinate of a key press
+// sets the step delay and the y coordinate sets the brightness.
+class PercolateApp : public App {
+public:
+  PercolateApp(int cols, int rows, int delay, double threshold,
+               Profiler &profiler)
+      : rows_(rows), delay_(delay),
+        percolation_(cols, rows, threshold, profiler) {}
+
+  const char *name() const override { return "percolate"; }
+
+  void activate(FrameBuffer &fb) override { fb.draw(percolation_.world()); }
+
+  void on_key(const monome_event_t *e, FrameBuffer &fb) override {
+    if (e->event_type == MONOME_BUTTON_DOWN) {
+      fb.set_intensity(16 * e->grid.y / rows_);
+      delay_ = 25 * (1 + e->grid.x);
+    }
+  }
+
+  int step(FrameBuffer &fb) override {
+    percolation_.step();
+    fb.draw(percolation_.world());
+    return delay_;
+  }
+
+  Percolation &percolation() { return percolation_; }
+
+private:
+  int rows_;
+  int delay_;
+  Percolation percolation_;
+};
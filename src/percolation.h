@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./checkpoint.h"
+#include "./log.h"
+#include "./profile.h"
+#include "./running_average.h"
+
+// The largest board that can be checkpointed.
+static const size_t kMaxCells = 256;
+
+// The estimator and trial state that's checkpointed across restarts.
+struct Snapshot {
+  int32_t cols;
+  int32_t rows;
+  int32_t state;
+  uint32_t next_size;
+  uint64_t count;
+  double threshold;
+  char rng[64];
+  uint8_t world[kMaxCells];
+  uint8_t next[kMaxCells][2];
+};
+
+// Percolation estimates the percolation threshold of a board, one trial at a
+// time: each trial fills the board at the current estimate, floods it from
+// the left edge, and updates the estimate with whether the flood reached the
+// right edge. It's shared by percolate and monod.
+class Percolation {
+public:
+  enum class State {
+    GENERATE = 1,
+    STEP = 2,
+    VICTORY = 3,
+    FAIL = 4,
+  };
+
+  Percolation(int cols, int rows, double threshold, Profiler &profiler)
+      : cols_(cols), rows_(rows), state_(State::GENERATE),
+        threshold_(threshold), world_(cols * rows, 0),
+        gen_(std::random_device()()), dist_(0., 1.), profiler_(profiler) {}
+
+  // delete copy ctor
+  Percolation(const Percolation &other) = delete;
+
+  // the lit cells, stored x * rows + y
+  const std::vector<uint8_t> &world() const { return world_; }
+
+  // the threshold estimate
+  const RunningAverage &threshold() const { return threshold_; }
+
+  // advance the current trial, or start a new one
+  void step() {
+    switch (state_) {
+    case State::GENERATE:
+      LOG_INFO("step=%zu threshold=%g", threshold_.count(), threshold_.val());
+      generate();
+      if (checkpoint_) {
+        save_rng();
+      }
+      state_ = State::STEP;
+      break;
+    case State::STEP:
+      simulate_step();
+      break;
+    case State::VICTORY:
+    case State::FAIL:
+      state_ = State::GENERATE;
+      break;
+    }
+    if (checkpoint_) {
+      ScopedPhase phase(profiler_, "checkpoint", world_.size());
+      save_checkpoint();
+    }
+  }
+
+  // checkpoint state to a file after every step, resuming from it if it's
+  // valid; returns true if the state was restored
+  bool enable_checkpoint(const std::string &path) {
+    if (world_.size() > kMaxCells) {
+      throw std::runtime_error("board is too large to checkpoint");
+    }
+    checkpoint_ = std::make_unique<Checkpoint<Snapshot>>(path);
+    save_rng();
+
+    Snapshot snap;
+    if (!checkpoint_->load(snap)) {
+      return false;
+    }
+    if (snap.cols != cols_ || snap.rows != rows_) {
+      LOG_WARNING("ignoring checkpoint for a %dx%d board", snap.cols,
+                  snap.rows);
+      return false;
+    }
+    restore(snap);
+    return true;
+  }
+
+private:
+  int cols_;
+  int rows_;
+  State state_;
+  std::set<std::pair<int, int>> next_;
+  RunningAverage threshold_;
+  std::vector<uint8_t> world_;
+
+  std::default_random_engine gen_;
+  std::uniform_real_distribution<double> dist_;
+
+  Profiler &profiler_;
+  std::unique_ptr<Checkpoint<Snapshot>> checkpoint_;
+  std::string rng_state_;
+
+  // generate a new board state
+  void generate() {
+    ScopedPhase phase(profiler_, "generate", world_.size());
+    std::fill(world_.begin(), world_.end(), 0);
+    for (int i = 0; i < cols_; i++) {
+      for (int j = 0; j < rows_; j++) {
+        if (dist_(gen_) < threshold_.val()) {
+          at(i, j) = 1;
+        }
+      }
+    }
+
+    // set up the next set of leds
+    next_.clear();
+    for (int j = 0; j < rows_; j++) {
+      if (off(0, j)) {
+        next_.insert({0, j});
+      }
+    }
+  }
+
+  void simulate_step() {
+    ScopedPhase phase(profiler_, "simulate_step", next_.size());
+    bool reached_end = false;
+    for (const auto &pr : next_) {
+      at(pr.first, pr.second) = 1;
+      if (pr.first == cols_ - 1) {
+        reached_end = true;
+      }
+    }
+
+    std::set<std::pair<int, int>> new_next;
+    for (const auto &pr : next_) {
+      if (off(pr.first - 1, pr.second)) {
+        new_next.insert({pr.first - 1, pr.second});
+      }
+      if (off(pr.first + 1, pr.second)) {
+        new_next.insert({pr.first + 1, pr.second});
+      }
+      if (off(pr.first, pr.second - 1)) {
+        new_next.insert({pr.first, pr.second - 1});
+      }
+      if (off(pr.first, pr.second + 1)) {
+        new_next.insert({pr.first, pr.second + 1});
+      }
+    }
+
+    if (reached_end) {
+      state_ = State::VICTORY;
+      threshold_.update(1);
+    } else if (new_next.empty()) {
+      state_ = State::FAIL;
+      threshold_.update(0);
+    } else {
+      next_ = new_next;
+    }
+  }
+
+  // remember the rng state for the next checkpoint; it only changes when a
+  // new board is generated
+  void save_rng() {
+    std::ostringstream os;
+    os << gen_;
+    rng_state_ = os.str();
+    if (rng_state_.size() >= sizeof(Snapshot::rng)) {
+      throw std::runtime_error("rng state is too large to checkpoint");
+    }
+  }
+
+  // save the current state; writeback is started when a trial finishes
+  void save_checkpoint() {
+    Snapshot snap;
+    std::memset(&snap, 0, sizeof(snap));
+    snap.cols = cols_;
+    snap.rows = rows_;
+    snap.state = static_cast<int32_t>(state_);
+    snap.count = threshold_.count();
+    snap.threshold = threshold_.val();
+    std::memcpy(snap.rng, rng_state_.data(), rng_state_.size());
+    std::copy(world_.begin(), world_.end(), snap.world);
+    for (const auto &pr : next_) {
+      snap.next[snap.next_size][0] = pr.first;
+      snap.next[snap.next_size][1] = pr.second;
+      snap.next_size++;
+    }
+    checkpoint_->save(snap,
+                      state_ == State::VICTORY || state_ == State::FAIL);
+  }
+
+  // resume from a checkpoint
+  void restore(const Snapshot &snap) {
+    state_ = static_cast<State>(snap.state);
+    threshold_ = RunningAverage(snap.threshold, snap.count);
+    std::istringstream is(
+        std::string(snap.rng, strnlen(snap.rng, sizeof(snap.rng))));
+    is >> gen_;
+    std::copy(snap.world, snap.world + world_.size(), world_.begin());
+    next_.clear();
+    for (uint32_t i = 0; i < snap.next_size && i < kMaxCells; i++) {
+      next_.insert({snap.next[i][0], snap.next[i][1]});
+    }
+    save_rng();
+  }
+
+  // is a light off?
+  bool off(int x, int y) {
+    if (x < 0 || y < 0) {
+      return false;
+    }
+    if (x >= cols_ || y >= rows_) {
+      return false;
+    }
+    return world_[x * rows_ + y] == 0;
+  }
+
+  // get ref to a coordinate with wraparound
+  uint8_t &at(int x, int y) {
+    if (x < 0) {
+      x += cols_;
+    } else if (x >= cols_) {
+      x -= cols_;
+    }
+
+    if (y < 0) {
+      y += rows_;
+    } else if (y >= rows_) {
+      y -= rows_;
+    }
+    return world_[x * rows_ + y];
+  }
+};
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// the hardware counters sampled by the profiler
+enum class Counter {
+  CYCLES = 0,
+  INSTRUCTIONS = 1,
+  L1D_MISSES = 2,
+  LLC_MISSES = 3,
+  BRANCH_MISSES = 4,
+};
+
+static const size_t kNumCounters = 5;
+
+// set by the profiler signal handlers, polled from the main loop
+static volatile sig_atomic_t profile_report_requested = 0;
+static volatile sig_atomic_t profile_exit_requested = 0;
+
+static void on_profile_signal(int sig) {
+  if (sig == SIGUSR1) {
+    profile_report_requested = 1;
+  } else {
+    profile_exit_requested = 1;
+  }
+}
+
+// PerfCounters is a group of perf_event_open counters for this thread.
+class PerfCounters {
+public:
+  PerfCounters() : leader_(-1) {}
+
+  // delete copy ctor
+  PerfCounters(const PerfCounters &other) = delete;
+
+  ~PerfCounters() {
+    for (int fd : fds_) {
+      close(fd);
+    }
+  }
+
+  // open the counter group; the cycle counter is required, the others are
+  // skipped if the PMU doesn't support them
+  void open() {
+    leader_ = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if (leader_ == -1) {
+      throw std::runtime_error(std::string("perf_event_open failed: ") +
+                               strerror(errno));
+    }
+    add(Counter::CYCLES, leader_);
+    add(Counter::INSTRUCTIONS,
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader_));
+    add(Counter::L1D_MISSES,
+        open_counter(PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_L1D |
+                         (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                     leader_));
+    add(Counter::LLC_MISSES,
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader_));
+    add(Counter::BRANCH_MISSES,
+        open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, leader_));
+
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+
+  // read the current counter values with a single syscall
+  void read(uint64_t (&out)[kNumCounters]) const {
+    uint64_t buf[1 + kNumCounters];
+    std::memset(out, 0, sizeof(out));
+    if (::read(leader_, buf, sizeof(buf)) == -1) {
+      return;
+    }
+    for (size_t i = 0; i < buf[0] && i < slots_.size(); i++) {
+      out[static_cast<size_t>(slots_[i])] = buf[1 + i];
+    }
+  }
+
+  // is the counter available?
+  bool has(Counter c) const {
+    for (Counter s : slots_) {
+      if (s == c) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  int leader_;
+  std::vector<int> fds_;
+  std::vector<Counter> slots_;
+
+  void add(Counter c, int fd) {
+    if (fd != -1) {
+      fds_.push_back(fd);
+      slots_.push_back(c);
+    }
+  }
+
+  static int open_counter(uint32_t type, uint64_t config, int group) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+  }
+};
+
+// Profiler accumulates hardware counters per named phase.
+class Profiler {
+public:
+  Profiler() : enabled_(false) {}
+
+  // delete copy ctor
+  Profiler(const Profiler &other) = delete;
+
+  ~Profiler() {
+    if (enabled_) {
+      report();
+    }
+  }
+
+  // open the counters and install the report signal handlers
+  void enable() {
+    counters_.open();
+    enabled_ = true;
+    signal(SIGUSR1, on_profile_signal);
+    signal(SIGINT, on_profile_signal);
+    signal(SIGTERM, on_profile_signal);
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // should the program exit (and report) now?
+  bool exit_requested() const { return profile_exit_requested; }
+
+  // report now if a signal asked for it
+  void poll() {
+    if (profile_report_requested) {
+      profile_report_requested = 0;
+      report();
+    }
+  }
+
+  // account a completed phase
+  void record(const char *phase, const uint64_t (&start)[kNumCounters],
+              size_t cells) {
+    uint64_t end[kNumCounters];
+    counters_.read(end);
+    auto it = phases_.find(phase);
+    if (it == phases_.end()) {
+      it = phases_.emplace(phase, Phase()).first;
+    }
+    Phase &p = it->second;
+    p.calls++;
+    p.cells += cells;
+    for (size_t i = 0; i < kNumCounters; i++) {
+      p.counts[i] += end[i] - start[i];
+    }
+  }
+
+  void read(uint64_t (&out)[kNumCounters]) const { counters_.read(out); }
+
+  // print the per-phase counters to stderr
+  void report() const {
+    std::ostream &os = std::cerr;
+    os << std::left << std::setw(16) << "phase" << std::right << std::setw(10)
+       << "calls" << std::setw(14) << "cycles" << std::setw(12)
+       << "cyc/cell" << std::setw(8) << "IPC" << std::setw(12) << "L1D-miss"
+       << std::setw(12) << "LLC-miss" << std::setw(12) << "br-miss"
+       << "\n";
+    for (const auto &pr : phases_) {
+      const Phase &p = pr.second;
+      const double cycles = p.get(Counter::CYCLES);
+      os << std::left << std::setw(16) << pr.first << std::right
+         << std::setw(10) << p.calls << std::setw(14) << p.get(Counter::CYCLES)
+         << std::fixed << std::setprecision(2) << std::setw(12)
+         << (p.cells ? cycles / p.cells : 0.) << std::setw(8)
+         << (cycles ? p.get(Counter::INSTRUCTIONS) / cycles : 0.);
+      for (Counter c : {Counter::L1D_MISSES, Counter::LLC_MISSES,
+                        Counter::BRANCH_MISSES}) {
+        os << std::setw(12);
+        if (counters_.has(c)) {
+          os << p.get(c);
+        } else {
+          os << "n/a";
+        }
+      }
+      os << "\n";
+    }
+    os.flush();
+  }
+
+private:
+  struct Phase {
+    uint64_t calls = 0;
+    uint64_t cells = 0;
+    uint64_t counts[kNumCounters] = {0};
+
+    uint64_t get(Counter c) const { return counts[static_cast<size_t>(c)]; }
+  };
+
+  bool enabled_;
+  PerfCounters counters_;
+  std::map<std::string, Phase, std::less<>> phases_;
+};
+
+// ScopedPhase profiles the enclosing scope; it's a no-op if the profiler is
+// disabled.
+class ScopedPhase {
+public:
+  ScopedPhase(Profiler &profiler, const char *phase, size_t cells)
+      : profiler_(profiler), phase_(phase), cells_(cells) {
+    if (profiler_.enabled()) {
+      profiler_.read(start_);
+    }
+  }
+
+  // delete copy ctor
+  ScopedPhase(const ScopedPhase &other) = delete;
+
+  ~ScopedPhase() {
+    if (profiler_.enabled()) {
+      profiler_.record(phase_, start_, cells_);
+    }
+  }
+
+private:
+  Profiler &profiler_;
+  const char *phase_;
+  size_t cells_;
+  uint64_t start_[kNumCounters];
+};
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// RingBuffer is a bounded lock-free queue that any number of threads can push
+// to and pop from. Neither side ever blocks: pushing to a full buffer and
+// popping from an empty one fail instead. The capacity must be a power of two.
+template <typename T> class RingBuffer {
+public:
+  explicit RingBuffer(size_t capacity)
+      : mask_(capacity - 1), cells_(new Cell[capacity]), head_(0), tail_(0) {
+    if (capacity == 0 || (capacity & mask_) != 0) {
+      throw std::runtime_error("ring buffer capacity must be a power of two");
+    }
+    for (size_t i = 0; i < capacity; i++) {
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // delete copy ctor
+  RingBuffer(const RingBuffer &other) = delete;
+
+  // add an item; returns false if the buffer is full
+  bool try_push(T &&val) {
+    Cell *cell;
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->val = std::move(val);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // remove the oldest item; returns false if the buffer is empty
+  bool try_pop(T &out) {
+    Cell *cell;
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      const size_t seq = cell->seq.load(std::memory_order_acquire);
+      const ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    out = std::move(cell->val);
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T val;
+  };
+
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // the consumer and producer positions are on separate cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <linux/serial.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <monome.h>
+
+// monome serial protocol ("mext") led commands
+static const uint8_t kMextLedOff = 0x10;
+static const uint8_t kMextLedOn = 0x11;
+static const uint8_t kMextLedAllOff = 0x12;
+static const uint8_t kMextLedAllOn = 0x13;
+static const uint8_t kMextLedIntensity = 0x17;
+
+// SerialTransport encodes led commands into a userspace buffer, and writes a
+// whole frame of them to the TTY with a single writev(2). The TTY is shared
+// with libmonome, which still reads key events from it and owns its termios
+// settings.
+class SerialTransport {
+public:
+  // the size of each buffer chunk; a full 16x16 frame fits in one
+  static const size_t kChunkSize = 1024;
+
+  // how long to wait for a full TTY to drain before giving up, in millis
+  static const int kWriteTimeout = 1000;
+
+  explicit SerialTransport(monome_t *m) : fd_(monome_get_fd(m)) {
+    if (fd_ == -1) {
+      throw std::runtime_error("invalid TTY fd");
+    }
+    const char *proto = monome_get_proto(m);
+    if (proto == nullptr || std::strcmp(proto, "mext") != 0) {
+      throw std::runtime_error(
+          std::string("buffered output needs a mext grid, not ") +
+          (proto == nullptr ? "an unknown protocol" : proto));
+    }
+
+    // ask the USB serial driver not to hold back small writes; not every
+    // driver supports this, so failure is ignored
+    serial_struct ss;
+    if (ioctl(fd_, TIOCGSERIAL, &ss) == 0) {
+      ss.flags |= ASYNC_LOW_LATENCY;
+      ioctl(fd_, TIOCSSERIAL, &ss);
+    }
+
+    chunks_.emplace_back();
+    chunks_.back().len = 0;
+  }
+
+  // delete copy ctor
+  SerialTransport(const SerialTransport &other) = delete;
+
+  void led_on(int x, int y) { append({kMextLedOn, uint8_t(x), uint8_t(y)}); }
+
+  void led_off(int x, int y) { append({kMextLedOff, uint8_t(x), uint8_t(y)}); }
+
+  void led_all(unsigned int val) {
+    append({val ? kMextLedAllOn : kMextLedAllOff});
+  }
+
+  void led_intensity(unsigned int intensity) {
+    append({kMextLedIntensity, uint8_t(intensity)});
+  }
+
+  // the number of bytes waiting to be flushed
+  size_t pending() const {
+    size_t n = 0;
+    for (const auto &chunk : chunks_) {
+      n += chunk.len;
+    }
+    return n;
+  }
+
+  // write out the buffered commands, waiting for the TTY to drain if its
+  // queue is full; throws if the write fails, in which case the unwritten
+  // bytes stay buffered so the grid never sees part of a command
+  void flush() {
+    if (pending() == 0) {
+      return;
+    }
+
+    std::vector<iovec> iov;
+    iov.reserve(chunks_.size());
+    for (auto &chunk : chunks_) {
+      if (chunk.len) {
+        iov.push_back({chunk.data.data(), chunk.len});
+      }
+    }
+
+    size_t i = 0;
+    while (i < iov.size()) {
+      const ssize_t n = writev(fd_, &iov[i], iov.size() - i);
+      if (n == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable()) {
+          continue;
+        }
+        const std::string err = strerror(errno);
+        keep(iov, i);
+        std::ostringstream os;
+        os << "failed to write " << pending() << " bytes of led commands: "
+           << err;
+        throw std::runtime_error(os.str());
+      }
+      // skip past what was written, in case of a short write
+      size_t written = n;
+      while (i < iov.size() && written >= iov[i].iov_len) {
+        written -= iov[i++].iov_len;
+      }
+      if (written) {
+        iov[i].iov_base = static_cast<uint8_t *>(iov[i].iov_base) + written;
+        iov[i].iov_len -= written;
+      }
+    }
+    reset();
+  }
+
+private:
+  struct Chunk {
+    std::array<uint8_t, kChunkSize> data;
+    size_t len;
+  };
+
+  int fd_;
+  std::vector<Chunk> chunks_;
+
+  void append(std::initializer_list<uint8_t> cmd) {
+    if (chunks_.back().len + cmd.size() > kChunkSize) {
+      chunks_.emplace_back();
+      chunks_.back().len = 0;
+    }
+    Chunk &chunk = chunks_.back();
+    std::memcpy(chunk.data.data() + chunk.len, cmd.begin(), cmd.size());
+    chunk.len += cmd.size();
+  }
+
+  // wait for the TTY to accept more output; returns false with errno set if
+  // it didn't within the timeout
+  bool wait_writable() const {
+    pollfd pfd = {fd_, POLLOUT, 0};
+    for (;;) {
+      const int n = poll(&pfd, 1, kWriteTimeout);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      if (n == 0) {
+        errno = ETIMEDOUT;
+      }
+      return n == 1;
+    }
+  }
+
+  // keep only the bytes a failed flush didn't write, starting at iov[i]
+  void keep(const std::vector<iovec> &iov, size_t i) {
+    std::vector<uint8_t> tail;
+    for (; i < iov.size(); i++) {
+      const uint8_t *p = static_cast<const uint8_t *>(iov[i].iov_base);
+      tail.insert(tail.end(), p, p + iov[i].iov_len);
+    }
+    reset();
+    for (size_t off = 0; off < tail.size(); off += kChunkSize) {
+      if (chunks_.back().len) {
+        chunks_.emplace_back();
+      }
+      Chunk &chunk = chunks_.back();
+      chunk.len = std::min(tail.size() - off, size_t(kChunkSize));
+      std::memcpy(chunk.data.data(), tail.data() + off, chunk.len);
+    }
+  }
+
+  // drop the buffered commands, keeping the first chunk for reuse
+  void reset() {
+    chunks_.resize(1);
+    chunks_.back().len = 0;
+  }
+};
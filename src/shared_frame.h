@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2019  Evan Klitzke <evan@eklitzke.org>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the largest board that can be published
+static const size_t kMaxFrameCells = 256;
+
+// the number of named stats published with each frame
+static const size_t kMaxFrameStats = 4;
+
+static const char kFrameMagic[8] = {'m', 'o', 'n', 'o', 'f', 'r', 'm', '1'};
+
+// FrameData is a published frame.
+struct FrameData {
+  int32_t cols;
+  int32_t rows;
+  uint32_t population;
+  uint64_t generation;
+  struct {
+    char name[16];
+    double value;
+  } stats[kMaxFrameStats];
+
+  // one byte per cell, stored x * rows + y
+  uint8_t cells[kMaxFrameCells];
+};
+
+// SharedFrame is the layout of the shared memory segment. The writer bumps seq
+// to an odd value before updating the data and to an even value after, so a
+// reader retries if seq was odd or changed while it was copying.
+struct SharedFrame {
+  char magic[8];
+  std::atomic<uint32_t> seq;
+  FrameData data;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "the seqlock must be lock free to work across processes");
+
+// a consistent copy of a published frame
+struct Frame {
+  int cols;
+  int rows;
+  uint32_t population;
+  uint64_t generation;
+  std::vector<std::pair<std::string, double>> stats;
+  std::vector<uint8_t> cells;
+};
+
+// map a shared memory segment
+static SharedFrame *MapSharedFrame(const std::string &name, bool writer) {
+  const int fd = shm_open(name.c_str(), writer ? O_RDWR | O_CREAT : O_RDONLY,
+                          0644);
+  if (fd == -1) {
+    throw std::runtime_error("failed to open shared memory " + name + ": " +
+                             strerror(errno));
+  }
+  if (writer && ftruncate(fd, sizeof(SharedFrame)) == -1) {
+    close(fd);
+    throw std::runtime_error("failed to size shared memory " + name + ": " +
+                             strerror(errno));
+  }
+  void *addr = mmap(nullptr, sizeof(SharedFrame),
+                    writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                    fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::runtime_error("failed to mmap shared memory " + name + ": " +
+                             strerror(errno));
+  }
+  return static_cast<SharedFrame *>(addr);
+}
+
+// FramePublisher publishes frames to a shared memory segment. Publishing is a
+// couple of memcpy calls; it never makes a syscall or waits for readers.
+class FramePublisher {
+public:
+  FramePublisher(const std::string &name, int cols, int rows)
+      : frame_(MapSharedFrame(name, true)) {
+    if (static_cast<size_t>(cols * rows) > kMaxFrameCells) {
+      munmap(frame_, sizeof(SharedFrame));
+      throw std::runtime_error("board is too large to publish");
+    }
+    const uint32_t seq = frame_->seq.load(std::memory_order_relaxed) | 1;
+    frame_->seq.store(seq, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(frame_->magic, kFrameMagic, sizeof(kFrameMagic));
+    std::memset(&frame_->data, 0, sizeof(frame_->data));
+    frame_->data.cols = cols;
+    frame_->data.rows = rows;
+    frame_->seq.store(seq + 1, std::memory_order_release);
+  }
+
+  // delete copy ctor
+  FramePublisher(const FramePublisher &other) = delete;
+
+  ~FramePublisher() { munmap(frame_, sizeof(SharedFrame)); }
+
+  // publish a frame; stats past kMaxFrameStats are ignored
+  void publish(const std::vector<uint8_t> &cells, uint64_t generation,
+               std::initializer_list<std::pair<const char *, double>> stats =
+                   {}) {
+    uint32_t population = 0;
+    for (uint8_t cell : cells) {
+      population += cell != 0;
+    }
+
+    const uint32_t seq = frame_->seq.load(std::memory_order_relaxed);
+    frame_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    FrameData &data = frame_->data;
+    data.generation = generation;
+    data.population = population;
+    size_t i = 0;
+    for (const auto &stat : stats) {
+      if (i == kMaxFrameStats) {
+        break;
+      }
+      std::strncpy(data.stats[i].name, stat.first,
+                   sizeof(data.stats[i].name) - 1);
+      data.stats[i].value = stat.second;
+      i++;
+    }
+    std::memcpy(data.cells, cells.data(),
+                std::min(cells.size(), kMaxFrameCells));
+    frame_->seq.store(seq + 2, std::memory_order_release);
+  }
+
+private:
+  SharedFrame *frame_;
+};
+
+// FrameReader reads frames published by a FramePublisher.
+class FrameReader {
+public:
+  explicit FrameReader(const std::string &name)
+      : frame_(MapSharedFrame(name, false)) {
+    if (std::memcmp(frame_->magic, kFrameMagic, sizeof(kFrameMagic)) != 0) {
+      munmap(const_cast<SharedFrame *>(frame_), sizeof(SharedFrame));
+      throw std::runtime_error(name + " is not a monolife frame");
+    }
+  }
+
+  // delete copy ctor
+  FrameReader(const FrameReader &other) = delete;
+
+  ~FrameReader() {
+    munmap(const_cast<SharedFrame *>(frame_), sizeof(SharedFrame));
+  }
+
+  // the sequence number of the latest frame; it changes when a new frame is
+  // published
+  uint32_t seq() const { return frame_->seq.load(std::memory_order_acquire); }
+
+  // copy out the latest frame, retrying while it's being written; returns
+  // false if no consistent frame could be read, e.g. because the writer died
+  // while publishing
+  bool read(Frame &out) const {
+    FrameData copy;
+    for (int tries = 0;; tries++) {
+      if (tries == kMaxTries) {
+        return false;
+      }
+      const uint32_t seq = frame_->seq.load(std::memory_order_acquire);
+      if (seq & 1) {
+        continue;
+      }
+      std::memcpy(&copy, &frame_->data, sizeof(copy));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (frame_->seq.load(std::memory_order_relaxed) == seq) {
+        break;
+      }
+    }
+
+    out.cols = copy.cols;
+    out.rows = copy.rows;
+    out.population = copy.population;
+    out.generation = copy.generation;
+    out.stats.clear();
+    for (const auto &stat : copy.stats) {
+      if (stat.name[0]) {
+        out.stats.push_back(
+            {std::string(stat.name, strnlen(stat.name, sizeof(stat.name))),
+             stat.value});
+      }
+    }
+    const size_t cells = std::min<size_t>(
+        std::max(copy.cols * copy.rows, 0), kMaxFrameCells);
+    out.cells.assign(copy.cells, copy.cells + cells);
+    return true;
+  }
+
+private:
+  static const int kMaxTries = 1000000;
+
+  const SharedFrame *frame_;
+};